@@ -0,0 +1,81 @@
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief Read the monotonic clock
+ * @return Current time in nanoseconds
+ */
+static inline uint64_t bench_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+#ifdef __linux__
+/**
+ * @brief Get the resident set size of the process
+ * @return Resident memory in bytes (0 if unavailable)
+ */
+static inline size_t bench_rss_bytes(void) {
+  size_t pages_total = 0, pages_resident = 0;
+
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (f == NULL)
+    return 0;
+  if (fscanf(f, "%zu %zu", &pages_total, &pages_resident) != 2)
+    pages_resident = 0;
+  fclose(f);
+
+  return pages_resident * (size_t)getpagesize();
+}
+#else
+#include <sys/resource.h>
+// Falls back to the peak resident size (bytes on macOS)
+static inline size_t bench_rss_bytes(void) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (size_t)usage.ru_maxrss;
+}
+#endif
+
+// Summary of a series of samples
+struct bench_stats {
+  double median;
+  double p99;
+  size_t samples;
+};
+
+static int bench_cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Compute the median and 99th percentile of samples (sorts them)
+ * @param samples Sample values
+ * @param count Number of samples (at least 1)
+ * @return Summary of the samples
+ */
+static inline struct bench_stats bench_summarize(double *samples,
+                                                 size_t count) {
+  qsort(samples, count, sizeof(*samples), bench_cmp_double);
+
+  // Nearest-rank percentile
+  size_t p99 = (count * 99 + 99) / 100;
+  return (struct bench_stats){
+      .median = samples[count / 2],
+      .p99 = samples[p99 - 1],
+      .samples = count,
+  };
+}
+
+// Prevent the compiler from optimizing a value away
+#define bench_keep(value) __asm__ volatile("" : : "r"(value) : "memory")
+
+#endif // _BENCH_H
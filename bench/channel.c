@@ -0,0 +1,88 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bench.h"
+#include "coroutine.h"
+
+// Channel throughput between coroutines of one stack, in messages per
+// second, for one producer and one consumer (1:1), PEERS producers and one
+// consumer (N:1) and one producer and PEERS consumers (1:N), over an
+// unbuffered, a small and a large buffered channel.
+
+#define MESSAGES 2000000
+#define PEERS 4
+#define STACK_SIZE (64 * 1024)
+
+struct peer {
+  sp_chan chan;
+  size_t count; // Messages to send (producers)
+  uintptr_t sum;
+};
+
+static void produce(sp_stack stack, void *arg) {
+  (void)stack;
+  struct peer *p = arg;
+  for (size_t i = 0; i < p->count; i++)
+    chan_send(p->chan, (void *)(uintptr_t)(i + 1));
+}
+
+static void consume(sp_stack stack, void *arg) {
+  (void)stack;
+  struct peer *p = arg;
+  void *value;
+  while (chan_recv(p->chan, &value))
+    p->sum += (uintptr_t)value;
+}
+
+/**
+ * @brief Move MESSAGES messages through one channel
+ * @param producers Number of producer coroutines
+ * @param consumers Number of consumer coroutines
+ * @return Messages per second
+ */
+static double run(size_t capacity, size_t producers, size_t consumers) {
+  sp_stack stack = init_stack(STACK_SIZE);
+  sp_chan chan = chan_create(stack, capacity);
+  struct peer peers[2 * PEERS];
+  sp_ctx ctxs[2 * PEERS];
+  size_t count = producers + consumers;
+
+  for (size_t i = 0; i < count; i++) {
+    bool producing = i < producers;
+    peers[i] = (struct peer){chan, producing ? MESSAGES / producers : 0, 0};
+    ctxs[i] = create_ctx(stack, producing ? produce : consume, &peers[i]);
+  }
+
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < producers; i++)
+    await_ctx(stack, ctxs[i]);
+  chan_close(chan);
+  for (size_t i = producers; i < count; i++)
+    await_ctx(stack, ctxs[i]);
+  uint64_t elapsed = bench_now_ns() - start;
+
+  for (size_t i = 0; i < count; i++) {
+    bench_keep(peers[i].sum);
+    destroy_ctx(ctxs[i]);
+  }
+  chan_destroy(chan);
+  deinit_stack(stack);
+
+  return (double)MESSAGES * 1e9 / (double)elapsed;
+}
+
+int main(void) {
+  size_t capacities[] = {0, 16, 1024};
+
+  printf("%d messages, %d peers\n", MESSAGES, PEERS);
+  printf("%-10s %14s %14s %14s\n", "capacity", "1:1 msg/s", "N:1 msg/s",
+         "1:N msg/s");
+
+  for (size_t i = 0; i < sizeof(capacities) / sizeof(capacities[0]); i++) {
+    printf("%-10zu %14.0f %14.0f %14.0f\n", capacities[i],
+           run(capacities[i], 1, 1), run(capacities[i], PEERS, 1),
+           run(capacities[i], 1, PEERS));
+  }
+
+  return 0;
+}
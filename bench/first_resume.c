@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+#include "coroutine.h"
+
+// Latency of the first resume of a new coroutine, which takes the page
+// faults of the stack it touches, in a burst of coroutines kept alive:
+// - cold: stacks are mapped by create_ctx and faulted in on first use
+// - prefault: set_stack_prefault populates the top of each new stack
+// - prewarm: prewarm_pool maps and pre-faults the whole burst up front
+
+#define COROUTINES 1000
+#define STACK_SIZE (64 * 1024)
+#define TOUCH_SIZE (16 * 1024) // Stack used before the first yield
+#define PREFAULT_SIZE (20 * 1024)
+
+static double create_ns[COROUTINES];
+static double resume_ns[COROUTINES];
+static sp_ctx ctxs[COROUTINES];
+
+static void touch(sp_stack stack, void *arg) {
+  (void)arg;
+  volatile char frame[TOUCH_SIZE];
+  memset((char *)frame, 1, sizeof(frame));
+  yield_ctx(stack);
+  bench_keep(frame[0]);
+}
+
+static void run(const char *label, size_t prefault, bool prewarm) {
+  sp_stack stack = init_stack(STACK_SIZE);
+  set_stack_prefault(stack, prefault);
+  if (prewarm) {
+    set_pool_watermarks(stack, COROUTINES, COROUTINES);
+    prewarm_pool(stack, COROUTINES);
+  }
+
+  for (size_t i = 0; i < COROUTINES; i++) {
+    uint64_t start = bench_now_ns();
+    ctxs[i] = create_ctx(stack, touch, NULL);
+    uint64_t created = bench_now_ns();
+    switch_ctx(stack, ctxs[i]);
+    uint64_t resumed = bench_now_ns();
+
+    create_ns[i] = (double)(created - start);
+    resume_ns[i] = (double)(resumed - created);
+  }
+
+  for (size_t i = 0; i < COROUTINES; i++) {
+    await_ctx(stack, ctxs[i]);
+    destroy_ctx(ctxs[i]);
+  }
+  trim_pool(stack, 0);
+  deinit_stack(stack);
+
+  struct bench_stats create = bench_summarize(create_ns, COROUTINES);
+  struct bench_stats resume = bench_summarize(resume_ns, COROUTINES);
+  printf("%-9s create %8.0f ns (p99 %8.0f)   first resume %8.0f ns (p99 "
+         "%8.0f)\n",
+         label, create.median, create.p99, resume.median, resume.p99);
+}
+
+int main(void) {
+  printf("%d coroutines, %d KiB stacks, %d KiB used before the first "
+         "yield\n",
+         COROUTINES, STACK_SIZE / 1024, TOUCH_SIZE / 1024);
+
+  run("cold", 0, false);
+  run("prefault", PREFAULT_SIZE, false);
+  run("prewarm", PREFAULT_SIZE, true);
+
+  return 0;
+}
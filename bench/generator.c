@@ -0,0 +1,54 @@
+#include <stdio.h>
+
+#include "bench.h"
+#include "coroutine.h"
+
+// Per-item cost of pulling integers out of a generator, compared with
+// pushing them into a callback (the usual alternative for iterators).
+
+#define ITEMS 100000000ull
+#define STACK_SIZE (64 * 1024)
+
+static void integers(sp_gen gen, void *arg) {
+  (void)arg;
+  for (uint64_t i = 0; i < ITEMS; i++)
+    gen_yield(gen, &i);
+}
+
+__attribute__((noinline)) static void add(void *sum, const uint64_t *value) {
+  *(uint64_t *)sum += *value;
+}
+
+__attribute__((noinline)) static void
+each_integer(void (*fn)(void *, const uint64_t *), void *arg) {
+  for (uint64_t i = 0; i < ITEMS; i++)
+    fn(arg, &i);
+}
+
+int main(void) {
+  uint64_t sum = 0;
+  uint64_t start = bench_now_ns();
+  each_integer(add, &sum);
+  uint64_t callback_ns = bench_now_ns() - start;
+  bench_keep(sum);
+
+  sp_stack stack = init_stack(STACK_SIZE);
+  sp_gen gen = gen_create(stack, integers, NULL);
+
+  sum = 0;
+  start = bench_now_ns();
+  uint64_t *value;
+  while ((value = gen_next(gen)) != NULL)
+    sum += *value;
+  uint64_t generator_ns = bench_now_ns() - start;
+  bench_keep(sum);
+
+  gen_destroy(gen);
+  deinit_stack(stack);
+
+  printf("%llu items\n", ITEMS);
+  printf("callback  %8.2f ns/item\n", (double)callback_ns / ITEMS);
+  printf("generator %8.2f ns/item\n", (double)generator_ns / ITEMS);
+
+  return 0;
+}
@@ -0,0 +1,112 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bench.h"
+#include "coroutine.h"
+
+// Small writes to a temporary file from WRITERS coroutines through the
+// io_uring reactor, against the same writes done with one pwrite each. The
+// reactor submits what the coroutines queue during a scheduler pass with a
+// single io_uring_enter: the table shows the system calls per write.
+
+#ifdef __linux__
+
+#define WRITES 200000
+#define WRITERS 64
+#define BLOCK 512
+
+struct writer {
+  sp_reactor reactor;
+  int fd;
+  size_t index;
+  char *block;
+};
+
+static void write_blocks(sp_stack stack, void *arg) {
+  (void)stack;
+  struct writer *w = arg;
+  for (size_t i = w->index; i < WRITES; i += WRITERS)
+    co_write(w->reactor, w->fd, w->block, BLOCK, (off_t)(i % 1024 * BLOCK));
+}
+
+/**
+ * @brief Measure writes through the reactor
+ * @param enters Set to the io_uring_enter calls per write
+ * @return Nanoseconds per write, or 0 if io_uring is unavailable
+ */
+static double run_reactor(int fd, double *enters) {
+  sp_stack stack = init_stack_ex(0, SP_STACK_SHARED);
+  sp_reactor reactor = reactor_create(stack, 0);
+  if (reactor == NULL) {
+    deinit_stack(stack);
+    return 0;
+  }
+
+  struct writer *writers = malloc(WRITERS * sizeof(*writers));
+  sp_ctx ctxs[WRITERS];
+  char *block = calloc(1, BLOCK);
+
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < WRITERS; i++) {
+    writers[i] = (struct writer){reactor, fd, i, block};
+    ctxs[i] = create_ctx(stack, write_blocks, &writers[i]);
+  }
+  for (size_t i = 0; i < WRITERS; i++) {
+    await_ctx(stack, ctxs[i]);
+    destroy_ctx(ctxs[i]);
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+
+  *enters = (double)reactor_enter_count(reactor) / WRITES;
+  free(block);
+  free(writers);
+  reactor_destroy(reactor);
+  deinit_stack(stack);
+
+  return (double)elapsed / WRITES;
+}
+
+static double run_pwrite(int fd) {
+  char *block = calloc(1, BLOCK);
+
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < WRITES; i++) {
+    if (pwrite(fd, block, BLOCK, (off_t)(i % 1024 * BLOCK)) != BLOCK)
+      abort();
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+
+  free(block);
+  return (double)elapsed / WRITES;
+}
+
+int main(void) {
+  char path[] = "/tmp/bench_io_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0)
+    return 1;
+  unlink(path);
+
+  double enters = 0;
+  double reactor_ns = run_reactor(fd, &enters);
+  double pwrite_ns = run_pwrite(fd);
+  close(fd);
+
+  printf("%-10s %14s %14s\n", "mode", "ns/write", "syscalls/write");
+  if (reactor_ns > 0)
+    printf("%-10s %14.1f %14.3f\n", "reactor", reactor_ns, enters);
+  else
+    printf("%-10s %14s %14s\n", "reactor", "unavailable", "-");
+  printf("%-10s %14.1f %14.3f\n", "pwrite", pwrite_ns, 1.0);
+
+  return 0;
+}
+
+#else
+
+int main(void) {
+  printf("io benchmark: Linux only, skipped\n");
+  return 0;
+}
+
+#endif // __linux__
@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "coroutine.h"
+
+// Spawn storm: create many coroutines that are queued long before they run,
+// and compare creation latency and resident memory of the queued backlog
+// with and without SP_STACK_LAZY.
+
+#define COROUTINES 50000 // stays under vm.max_map_count for eager mappings
+#define STACK_SIZE (64 * 1024)
+
+static void work(sp_stack stack, void *arg) {
+  (void)stack;
+  volatile char frame[256];
+  frame[0] = (char)(size_t)arg;
+  bench_keep(frame[0]);
+}
+
+static void run(const char *label, unsigned flags) {
+  sp_ctx *ctxs = malloc(COROUTINES * sizeof(*ctxs));
+  sp_stack stack = init_stack_ex(STACK_SIZE, flags);
+  size_t rss_before = bench_rss_bytes();
+
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < COROUTINES; i++)
+    ctxs[i] = create_ctx(stack, work, (void *)i);
+  uint64_t create_ns = bench_now_ns() - start;
+  size_t rss_queued = bench_rss_bytes();
+
+  start = bench_now_ns();
+  for (size_t i = 0; i < COROUTINES; i++) {
+    await_ctx(stack, ctxs[i]);
+    destroy_ctx(ctxs[i]);
+  }
+  uint64_t run_ns = bench_now_ns() - start;
+
+  printf("%-6s %8.1f ns/create %8.1f ns/run %8zu bytes/queued coroutine\n",
+         label, (double)create_ns / COROUTINES, (double)run_ns / COROUTINES,
+         (rss_queued - rss_before) / COROUTINES);
+
+  trim_pool(stack, 0);
+  deinit_stack(stack);
+  free(ctxs);
+}
+
+int main(void) {
+  printf("%d queued coroutines, %d KiB stacks\n", COROUTINES,
+         STACK_SIZE / 1024);
+
+  run("eager", 0);
+  run("lazy", SP_STACK_LAZY);
+
+  return 0;
+}
@@ -0,0 +1,80 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "coroutine.h"
+
+// Fan-out throughput of the work-stealing runtime for a worker-count sweep.
+// Each request fans out into CHILDREN tasks doing CPU work in CHUNKS slices
+// separated by yield_task. Usage: runtime_scaling [max_workers]
+
+#define REQUESTS 256
+#define CHILDREN 32
+#define CHUNKS 4
+#define WORK_PER_CHUNK 20000
+
+static atomic_ulong g_sink;
+
+static void child(sp_runtime rt, void *arg) {
+  uint64_t x = (uint64_t)(uintptr_t)arg | 1;
+
+  for (int c = 0; c < CHUNKS; c++) {
+    for (int i = 0; i < WORK_PER_CHUNK; i++) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+    }
+    yield_task(rt);
+  }
+
+  atomic_fetch_add_explicit(&g_sink, x, memory_order_relaxed);
+}
+
+static void request(sp_runtime rt, void *arg) {
+  for (uintptr_t i = 0; i < CHILDREN; i++)
+    spawn_task(rt, child, (void *)((uintptr_t)arg * CHILDREN + i));
+}
+
+static double run(size_t workers) {
+  sp_runtime rt = init_runtime(workers, 64 * 1024);
+
+  uint64_t start = bench_now_ns();
+  for (uintptr_t i = 0; i < REQUESTS; i++)
+    spawn_task(rt, request, (void *)i);
+  wait_runtime(rt);
+  uint64_t elapsed = bench_now_ns() - start;
+
+  deinit_runtime(rt);
+  return (double)elapsed / 1e9;
+}
+
+int main(int argc, char **argv) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t max_workers = argc > 1 ? (size_t)atol(argv[1]) : (size_t)cpus;
+  if (max_workers == 0)
+    max_workers = 1;
+
+  printf("%d requests x %d tasks, %ld online cpus\n", REQUESTS, CHILDREN,
+         cpus);
+
+  // Powers of two, always ending with max_workers
+  double base = 0;
+  for (size_t workers = 1;; workers *= 2) {
+    if (workers > max_workers)
+      workers = max_workers;
+
+    double seconds = run(workers);
+    if (workers == 1)
+      base = seconds;
+
+    printf("%3zu workers %10.0f tasks/s %6.2fx\n", workers,
+           REQUESTS * CHILDREN / seconds, base / seconds);
+
+    if (workers == max_workers)
+      break;
+  }
+
+  return 0;
+}
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "coroutine.h"
+
+// Compare per-coroutine mmap stacks against the shared (copy-on-switch)
+// stack: resident memory per suspended coroutine and cost of a yield.
+
+#define COROUTINES 10000
+#define ROUNDS 100
+#define STACK_SIZE (64 * 1024)
+#define LIVE_BYTES 512 // stack used by each coroutine while suspended
+
+static void idle_worker(sp_stack stack, void *arg) {
+  (void)arg;
+  volatile char live[LIVE_BYTES];
+  for (size_t i = 0; i < sizeof(live); i += 64)
+    live[i] = (char)i;
+
+  for (int r = 0; r < ROUNDS; r++)
+    yield_ctx(stack);
+
+  bench_keep(live[0]);
+}
+
+static void run(const char *label, unsigned flags) {
+  sp_ctx *ctxs = malloc(COROUTINES * sizeof(*ctxs));
+  size_t rss_before = bench_rss_bytes();
+
+  sp_stack stack = init_stack_ex(STACK_SIZE, flags);
+  for (size_t i = 0; i < COROUTINES; i++)
+    ctxs[i] = create_ctx(stack, idle_worker, NULL);
+
+  // Every coroutine runs once and is now suspended with live frames
+  yield_ctx(stack);
+  size_t rss_idle = bench_rss_bytes();
+
+  uint64_t start = bench_now_ns();
+  for (int r = 0; r < ROUNDS; r++)
+    yield_ctx(stack);
+  uint64_t elapsed = bench_now_ns() - start;
+
+  // Each round switches through every coroutine and back to main
+  double switches = (double)ROUNDS * (COROUTINES + 1);
+
+  printf("%-8s %10.1f ns/switch %10zu bytes/coroutine\n", label,
+         (double)elapsed / switches, (rss_idle - rss_before) / COROUTINES);
+
+  for (size_t i = 0; i < COROUTINES; i++) {
+    while (!is_ctx_finished(ctxs[i]))
+      yield_ctx(stack);
+    destroy_ctx(ctxs[i]);
+  }
+
+  trim_pool(stack, 0);
+  deinit_stack(stack);
+  free(ctxs);
+}
+
+int main(void) {
+  printf("%d coroutines, %d KiB stacks, %d live bytes each\n", COROUTINES,
+         STACK_SIZE / 1024, LIVE_BYTES);
+
+  run("mmap", 0);
+  run("shared", SP_STACK_SHARED);
+
+  return 0;
+}
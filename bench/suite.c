@@ -0,0 +1,282 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "coroutine.h"
+
+// Microbenchmark suite run by `./nob bench`: context switch latency, yield
+// ring, spawn/destroy throughput and memory per idle coroutine. Every
+// benchmark times SAMPLES batches of operations and reports the median and
+// 99th percentile cost of one operation. Results are printed as a table and
+// can be written as JSON lines (--json) and compared against a previous run
+// (--baseline): a median more than --threshold percent above the baseline is
+// reported as a regression and makes the suite exit with status 1.
+
+#define STACK_SIZE (64 * 1024)
+#define SAMPLES 1000
+#define BATCH 256
+#define RING_SIZE 8
+#define SPAWN_BATCH 64
+#define IDLE_COROUTINES 4096
+#define IDLE_SAMPLES 5
+#define DEFAULT_THRESHOLD 10.0
+
+struct result {
+  const char *name;
+  const char *unit;
+  struct bench_stats stats;
+};
+
+static double samples[SAMPLES];
+
+static void spin(sp_stack stack, void *arg) {
+  const bool *stop = arg;
+  while (!*stop)
+    yield_ctx(stack);
+}
+
+static void noop(sp_stack stack, void *arg) {
+  (void)stack;
+  (void)arg;
+}
+
+static void idle(sp_stack stack, void *arg) {
+  (void)arg;
+  yield_ctx(stack);
+}
+
+// Main switches to a coroutine which yields straight back: two switches
+static struct result bench_pingpong(void) {
+  sp_stack stack = init_stack(STACK_SIZE);
+  bool stop = false;
+  sp_ctx ctx = create_ctx(stack, spin, &stop);
+
+  for (size_t s = 0; s < SAMPLES; s++) {
+    uint64_t start = bench_now_ns();
+    for (size_t i = 0; i < BATCH; i++)
+      switch_ctx(stack, ctx);
+    samples[s] = (double)(bench_now_ns() - start) / (2 * BATCH);
+  }
+
+  stop = true;
+  while (!is_ctx_finished(ctx))
+    yield_ctx(stack);
+  destroy_ctx(ctx);
+  deinit_stack(stack);
+
+  return (struct result){"switch_pingpong", "ns/switch",
+                         bench_summarize(samples, SAMPLES)};
+}
+
+// Main and RING_SIZE coroutines yield round-robin through the run queue
+static struct result bench_yield_ring(void) {
+  sp_stack stack = init_stack(STACK_SIZE);
+  bool stop = false;
+  sp_ctx ctxs[RING_SIZE];
+  for (size_t i = 0; i < RING_SIZE; i++)
+    ctxs[i] = create_ctx(stack, spin, &stop);
+
+  for (size_t s = 0; s < SAMPLES; s++) {
+    uint64_t start = bench_now_ns();
+    for (size_t i = 0; i < BATCH / RING_SIZE; i++)
+      yield_ctx(stack);
+    double yields = (double)(BATCH / RING_SIZE) * (RING_SIZE + 1);
+    samples[s] = (double)(bench_now_ns() - start) / yields;
+  }
+
+  stop = true;
+  for (size_t i = 0; i < RING_SIZE; i++) {
+    while (!is_ctx_finished(ctxs[i]))
+      yield_ctx(stack);
+    destroy_ctx(ctxs[i]);
+  }
+  deinit_stack(stack);
+
+  return (struct result){"yield_ring", "ns/yield",
+                         bench_summarize(samples, SAMPLES)};
+}
+
+// Full lifecycle of a short coroutine: create, run to completion, destroy
+static struct result bench_spawn_destroy(void) {
+  sp_stack stack = init_stack(STACK_SIZE);
+
+  for (size_t s = 0; s < SAMPLES; s++) {
+    uint64_t start = bench_now_ns();
+    for (size_t i = 0; i < SPAWN_BATCH; i++) {
+      sp_ctx ctx = create_ctx(stack, noop, NULL);
+      switch_ctx(stack, ctx);
+      destroy_ctx(ctx);
+    }
+    samples[s] = (double)(bench_now_ns() - start) / SPAWN_BATCH;
+  }
+
+  deinit_stack(stack);
+
+  return (struct result){"spawn_destroy", "ns/coroutine",
+                         bench_summarize(samples, SAMPLES)};
+}
+
+// Resident memory of coroutines suspended after their first yield
+static struct result bench_idle_memory(const char *name, unsigned flags) {
+  static sp_ctx ctxs[IDLE_COROUTINES];
+
+  for (size_t s = 0; s < IDLE_SAMPLES; s++) {
+    size_t rss_before = bench_rss_bytes();
+
+    sp_stack stack = init_stack_ex(STACK_SIZE, flags);
+    for (size_t i = 0; i < IDLE_COROUTINES; i++)
+      ctxs[i] = create_ctx(stack, idle, NULL);
+    yield_ctx(stack);
+
+    size_t rss_idle = bench_rss_bytes();
+    samples[s] = rss_idle > rss_before
+                     ? (double)(rss_idle - rss_before) / IDLE_COROUTINES
+                     : 0;
+
+    for (size_t i = 0; i < IDLE_COROUTINES; i++) {
+      while (!is_ctx_finished(ctxs[i]))
+        yield_ctx(stack);
+      destroy_ctx(ctxs[i]);
+    }
+    trim_pool(stack, 0);
+    deinit_stack(stack);
+  }
+
+  return (struct result){name, "bytes/coroutine",
+                         bench_summarize(samples, IDLE_SAMPLES)};
+}
+
+static bool write_json(const char *path, const struct result *results,
+                       size_t count) {
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    perror(path);
+    return false;
+  }
+
+  for (size_t i = 0; i < count; i++)
+    fprintf(f,
+            "{\"name\":\"%s\",\"unit\":\"%s\",\"median\":%.3f,"
+            "\"p99\":%.3f,\"samples\":%zu}\n",
+            results[i].name, results[i].unit, results[i].stats.median,
+            results[i].stats.p99, results[i].stats.samples);
+
+  fclose(f);
+  return true;
+}
+
+/**
+ * @brief Look up the median of a benchmark in a JSON lines baseline file
+ * @param f Baseline file
+ * @param name Benchmark name
+ * @param median Set to the baseline median when found
+ * @return true if the benchmark was found
+ */
+static bool find_baseline(FILE *f, const char *name, double *median) {
+  char line[512];
+  rewind(f);
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+    char found[128];
+    const char *field = strstr(line, "\"median\":");
+    if (sscanf(line, " {\"name\":\"%127[^\"]\"", found) != 1 || field == NULL)
+      continue;
+    if (strcmp(found, name) == 0)
+      return sscanf(field, "\"median\":%lf", median) == 1;
+  }
+
+  return false;
+}
+
+/**
+ * @brief Compare the results against a baseline and print the deltas
+ * @return Number of regressions (-1 if the baseline cannot be read)
+ */
+static int compare_baseline(const char *path, const struct result *results,
+                            size_t count, double threshold) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    return -1;
+  }
+
+  int regressions = 0;
+  printf("\n%-20s %12s %12s %9s  (baseline %s, threshold %.1f%%)\n",
+         "benchmark", "baseline", "current", "delta", path, threshold);
+
+  for (size_t i = 0; i < count; i++) {
+    double base;
+    if (!find_baseline(f, results[i].name, &base)) {
+      printf("%-20s %12s %12.1f %9s\n", results[i].name, "-",
+             results[i].stats.median, "new");
+      continue;
+    }
+
+    double delta = base > 0 ? (results[i].stats.median - base) / base * 100
+                            : 0;
+    bool regressed = delta > threshold;
+    regressions += regressed;
+
+    printf("%-20s %12.1f %12.1f %+8.1f%%%s\n", results[i].name, base,
+           results[i].stats.median, delta, regressed ? "  REGRESSION" : "");
+  }
+
+  fclose(f);
+  return regressions;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [--json FILE] [--baseline FILE] [--threshold PERCENT]\n",
+          prog);
+}
+
+int main(int argc, char **argv) {
+  const char *json_path = NULL;
+  const char *baseline_path = NULL;
+  double threshold = DEFAULT_THRESHOLD;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+      baseline_path = argv[++i];
+    } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+      threshold = atof(argv[++i]);
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  struct result results[] = {
+      bench_pingpong(),
+      bench_yield_ring(),
+      bench_spawn_destroy(),
+      bench_idle_memory("idle_memory", 0),
+      bench_idle_memory("idle_memory_shared", SP_STACK_SHARED),
+  };
+  size_t count = sizeof(results) / sizeof(results[0]);
+
+  printf("%-20s %12s %12s  %s\n", "benchmark", "median", "p99", "unit");
+  for (size_t i = 0; i < count; i++)
+    printf("%-20s %12.1f %12.1f  %s\n", results[i].name,
+           results[i].stats.median, results[i].stats.p99, results[i].unit);
+
+  if (json_path != NULL && !write_json(json_path, results, count))
+    return 2;
+
+  if (baseline_path != NULL) {
+    int regressions = compare_baseline(baseline_path, results, count, threshold);
+    if (regressions < 0)
+      return 2;
+    if (regressions > 0) {
+      printf("%d benchmark(s) regressed\n", regressions);
+      return 1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "coroutine.h"
+
+// switch_ctx latency between two coroutines while N other coroutines are
+// registered on the same stack. The pair is created last, so a lookup that
+// scans the active contexts would grow with N. The stack is shared so that a
+// million idle coroutines only cost their primed frames.
+
+#define SWITCHES 200000
+#define STACK_SIZE (64 * 1024)
+
+struct pair {
+  sp_ctx partner;
+  int turns;
+  uint64_t *end_ns;
+};
+
+static void noop(sp_stack stack, void *arg) {
+  (void)stack;
+  (void)arg;
+}
+
+static void ping_pong(sp_stack stack, void *arg) {
+  struct pair *p = arg;
+  for (int i = 0; i < p->turns; i++)
+    switch_ctx(stack, p->partner);
+
+  // Stop the clock before finishing runs through the idle coroutines
+  if (*p->end_ns == 0)
+    *p->end_ns = bench_now_ns();
+}
+
+static void run(size_t idle) {
+  sp_stack stack = init_stack_ex(STACK_SIZE, SP_STACK_SHARED);
+  sp_ctx *idle_ctxs = malloc(idle * sizeof(*idle_ctxs));
+
+  for (size_t i = 0; i < idle; i++)
+    idle_ctxs[i] = create_ctx(stack, noop, NULL);
+
+  uint64_t end = 0;
+  struct pair ping = {.turns = SWITCHES / 2, .end_ns = &end};
+  struct pair pong = {.turns = SWITCHES / 2, .end_ns = &end};
+  sp_ctx ping_ctx = create_ctx(stack, ping_pong, &ping);
+  sp_ctx pong_ctx = create_ctx(stack, ping_pong, &pong);
+  ping.partner = pong_ctx;
+  pong.partner = ping_ctx;
+
+  uint64_t start = bench_now_ns();
+  switch_ctx(stack, ping_ctx);
+  uint64_t elapsed = end - start;
+
+  printf("%8zu live coroutines %8.1f ns/switch\n", idle + 2,
+         (double)elapsed / SWITCHES);
+
+  // Let everything run to completion before tearing down
+  while (!is_ctx_finished(ping_ctx) || !is_ctx_finished(pong_ctx))
+    yield_ctx(stack);
+  for (size_t i = 0; i < idle; i++) {
+    while (!is_ctx_finished(idle_ctxs[i]))
+      yield_ctx(stack);
+    destroy_ctx(idle_ctxs[i]);
+  }
+
+  destroy_ctx(ping_ctx);
+  destroy_ctx(pong_ctx);
+  deinit_stack(stack);
+  free(idle_ctxs);
+}
+
+int main(void) {
+  for (size_t idle = 10; idle <= 1000000; idle *= 10)
+    run(idle);
+
+  return 0;
+}
@@ -0,0 +1,119 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bench.h"
+#include "coroutine.h"
+
+// Cost of arming and cancelling a timer (park_ctx_until woken up by
+// unpark_ctx) and of a yield, with 0 to 100k other timers pending. The
+// pending timers belong to idle coroutines of a shared stack parked for an
+// hour; with a timing wheel both costs should not depend on their number.
+
+#define ITERATIONS 1000000
+#define HOUR_NS (3600ull * 1000000000ull)
+
+static void idle(sp_stack stack, void *arg) {
+  (void)arg;
+  park_ctx_until(stack, get_time_ns() + HOUR_NS);
+}
+
+// Wakes main up on every turn
+static void waker(sp_stack stack, void *arg) {
+  volatile bool *stop = arg;
+  while (!*stop) {
+    unpark_ctx(stack, NULL);
+    yield_ctx(stack);
+  }
+}
+
+static void yielder(sp_stack stack, void *arg) {
+  volatile bool *stop = arg;
+  while (!*stop)
+    yield_ctx(stack);
+}
+
+/**
+ * @brief Measure main parking with or without a timer
+ * @param pending Idle coroutines with a pending timer
+ * @param timed Park with park_ctx_until rather than park_ctx
+ * @return Nanoseconds per park/wake-up round trip
+ */
+static double run_park(size_t pending, bool timed) {
+  sp_stack stack = init_stack_ex(0, SP_STACK_SHARED);
+  sp_ctx *idlers = malloc(pending * sizeof(*idlers));
+  for (size_t i = 0; i < pending; i++)
+    idlers[i] = create_ctx(stack, idle, NULL);
+  yield_ctx(stack); // Every idler parks on its timer
+
+  volatile bool stop = false;
+  sp_ctx ctx = create_ctx(stack, waker, (void *)&stop);
+
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < ITERATIONS; i++) {
+    if (timed)
+      park_ctx_until(stack, get_time_ns() + HOUR_NS);
+    else
+      park_ctx(stack);
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+
+  stop = true;
+  await_ctx(stack, ctx);
+  destroy_ctx(ctx);
+  for (size_t i = 0; i < pending; i++) {
+    unpark_ctx(stack, idlers[i]);
+    await_ctx(stack, idlers[i]);
+    destroy_ctx(idlers[i]);
+  }
+  free(idlers);
+  deinit_stack(stack);
+
+  return (double)elapsed / ITERATIONS;
+}
+
+/**
+ * @brief Measure a yield round trip while timers are pending
+ * @return Nanoseconds per yield_ctx of main
+ */
+static double run_yield(size_t pending) {
+  sp_stack stack = init_stack_ex(0, SP_STACK_SHARED);
+  sp_ctx *idlers = malloc(pending * sizeof(*idlers));
+  for (size_t i = 0; i < pending; i++)
+    idlers[i] = create_ctx(stack, idle, NULL);
+  yield_ctx(stack);
+
+  volatile bool stop = false;
+  sp_ctx ctx = create_ctx(stack, yielder, (void *)&stop);
+
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < ITERATIONS; i++)
+    yield_ctx(stack);
+  uint64_t elapsed = bench_now_ns() - start;
+
+  stop = true;
+  await_ctx(stack, ctx);
+  destroy_ctx(ctx);
+  for (size_t i = 0; i < pending; i++) {
+    unpark_ctx(stack, idlers[i]);
+    await_ctx(stack, idlers[i]);
+    destroy_ctx(idlers[i]);
+  }
+  free(idlers);
+  deinit_stack(stack);
+
+  return (double)elapsed / ITERATIONS;
+}
+
+int main(void) {
+  size_t pending[] = {0, 1000, 100000};
+
+  printf("%-10s %14s %14s %14s\n", "pending", "park ns", "timed park ns",
+         "yield ns");
+  for (size_t i = 0; i < sizeof(pending) / sizeof(pending[0]); i++) {
+    printf("%-10zu %14.1f %14.1f %14.1f\n", pending[i],
+           run_park(pending[i], false), run_park(pending[i], true),
+           run_yield(pending[i]));
+  }
+
+  return 0;
+}
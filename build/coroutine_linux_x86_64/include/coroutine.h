@@ -0,0 +1,1008 @@
+#ifndef _COROUTINE_H
+#define _COROUTINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/types.h>
+#endif // __linux__
+
+// User can define STACK_CAPACITY before including this header
+#ifndef STACK_CAPACITY
+#define STACK_CAPACITY (1024 * getpagesize())
+#endif // STACK_CAPACITY
+
+// Opaque coroutine context type
+typedef struct s_ctx *sp_ctx;
+
+// Opaque stack type
+typedef struct s_stack *sp_stack;
+
+// Opaque multi-threaded runtime type
+typedef struct s_runtime *sp_runtime;
+
+// Opaque generator type
+typedef struct s_gen *sp_gen;
+
+// Opaque channel type
+typedef struct s_chan *sp_chan;
+
+// Capacity of a channel that never blocks senders (see chan_create)
+#define SP_CHAN_UNBOUNDED ((size_t)-1)
+
+// Opaque synchronization types
+typedef struct s_mutex *sp_mutex;
+typedef struct s_cond *sp_cond;
+typedef struct s_sem *sp_sem;
+
+#ifdef __linux__
+// Opaque io_uring reactor type (Linux only)
+typedef struct s_reactor *sp_reactor;
+#endif // __linux__
+
+/**
+ * Stack creation flags (see init_stack_ex)
+ */
+enum {
+  // Carve coroutine stacks out of a few large reservations (ARENA_RESERVATION
+  // bytes each) using power-of-two size classes, instead of creating one
+  // mapping per coroutine. Keeps the number of mappings far below
+  // vm.max_map_count when holding many coroutines.
+  SP_STACK_ARENA = 1 << 0,
+  // Map a PROT_NONE region (STACK_GUARD_SIZE bytes) below each coroutine
+  // stack and install a SIGSEGV/SIGBUS handler, running on an alternate
+  // signal stack, that reports which context overflowed (and its function)
+  // before terminating the process. The alternate signal stack is installed
+  // on the thread calling init_stack_ex, and removed when the last guarded
+  // stack of that thread is deinitialized. With SP_STACK_ARENA, each guard
+  // splits the arena reservation: a suspended coroutine costs two mappings
+  // again, so vm.max_map_count bounds the number of coroutines.
+  SP_STACK_GUARD = 1 << 1,
+  // Run every coroutine on a single stack of `stack_capacity` bytes. When a
+  // coroutine is resumed, the live frames of the previous one (from its saved
+  // stack pointer to the top) are copied to a heap buffer and its own frames
+  // are copied back in place. Trades a memcpy per switch for a few hundred
+  // bytes per suspended coroutine. Pointers to stack variables must not be
+  // shared between coroutines of such a stack.
+  SP_STACK_SHARED = 1 << 2,
+  // Defer the stack of a new coroutine until it first runs: create_ctx only
+  // records the function and its argument, and the stack is mapped and
+  // primed on first resume. A queued coroutine that has not started costs
+  // its context struct only. Contexts reused from the pool already own a
+  // stack and are primed right away. Has no effect with SP_STACK_SHARED.
+  SP_STACK_LAZY = 1 << 3,
+  // Measure the peak stack usage of coroutines (see ctx_stack_high_water).
+  // Stacks start zero-filled, so the deepest non-zero word marks the peak;
+  // a pooled stack has its used part cleared when it is reused.
+  SP_STACK_HIGH_WATER = 1 << 4,
+};
+
+/**
+ * Guard page choice of a single coroutine (see sp_ctx_attr)
+ */
+enum {
+  SP_GUARD_DEFAULT = 0, // Follow SP_STACK_GUARD of the stack
+  SP_GUARD_ON,          // Map a guard region and report overflows
+  SP_GUARD_OFF,         // No guard region
+};
+
+/**
+ * Per-coroutine creation attributes (see create_ctx_ex). Zero-initialized
+ * attributes behave like create_ctx.
+ */
+typedef struct sp_ctx_attr {
+  // Stack size in bytes (0 uses the capacity of the stack)
+  size_t stack_size;
+  // SP_GUARD_* choice for this coroutine
+  int guard;
+  // Bytes at the top of the stack faulted in at creation (0 for none).
+  // Overrides SP_STACK_LAZY for this coroutine.
+  size_t prefault;
+  // Caller-owned stack memory of stack_size bytes, or NULL to map one. The
+  // memory is not freed by destroy_ctx and must outlive the coroutine.
+  void *stack;
+  // Name reported on stack overflow (not copied, must outlive the context)
+  const char *name;
+} sp_ctx_attr;
+
+/**
+ * Coroutine function type and finalizer function type
+ * coroutine: function that takes a void* argument and returns void
+ */
+typedef void (*sp_func)(sp_stack, void *);
+
+/**
+ * Runtime task function type
+ * task: function that takes the runtime and a void* argument and returns void
+ */
+typedef void (*sp_task_func)(sp_runtime, void *);
+
+/**
+ * Generator function type
+ * generator: function that takes its generator and a void* argument, hands
+ * values out with gen_yield and returns void when exhausted
+ */
+typedef void (*sp_gen_func)(sp_gen, void *);
+
+/*
+ * Coroutine management functions
+ */
+
+/**
+ * @brief Initialize a new stack for coroutines
+ * @param stack_capacity The capacity of the stack in bytes (if 0, use default
+ * STACK_CAPACITY)
+ * @return Stack object
+ */
+extern sp_stack init_stack(size_t stack_capacity);
+
+/**
+ * @brief Initialize a new stack for coroutines with creation flags
+ * @param stack_capacity The capacity of the stack in bytes (if 0, use default
+ * STACK_CAPACITY)
+ * @param flags Bitwise or of SP_STACK_* flags
+ * @return Stack object
+ */
+extern sp_stack init_stack_ex(size_t stack_capacity, unsigned flags);
+
+extern void deinit_stack(sp_stack stack);
+
+/**
+ * @brief Create a new coroutine context
+ * @param fn The coroutine function to execute
+ * @param arg The argument to pass to the coroutine function
+ * @return Coroutine context object
+ */
+extern sp_ctx create_ctx(sp_stack stack, sp_func fn, void *arg);
+
+/**
+ * @brief Create a new coroutine context with its own attributes
+ *
+ * Contexts whose stack differs from the default of `stack` (size, guard or
+ * user memory) do not go through the pool: their stack is released by
+ * destroy_ctx. On a SP_STACK_SHARED stack only `name` applies, and a stack
+ * of its own is rejected.
+ *
+ * @param fn The coroutine function to execute
+ * @param arg The argument to pass to the coroutine function
+ * @param attr Creation attributes (NULL behaves like create_ctx)
+ * @return Coroutine context object
+ */
+extern sp_ctx create_ctx_ex(sp_stack stack, sp_func fn, void *arg,
+                            const sp_ctx_attr *attr);
+
+/**
+ * @brief Get the name given to a context by create_ctx_ex
+ * @param ctx A context (NULL for the main context)
+ * @return The name, or NULL if the context has none
+ */
+extern const char *get_ctx_name(sp_ctx ctx);
+
+/**
+ * @brief Unregister a coroutine context from the stack
+ * @param stack The stack containing the coroutine context
+ * @param ctx The coroutine context to unregister
+ */
+extern void unregister_ctx(sp_stack stack, sp_ctx ctx);
+
+/**
+ * @brief Register a suspended context on a stack
+ *
+ * Counterpart of unregister_ctx: the context is queued as runnable on
+ * `stack`, which may differ from the stack it was created on (the context
+ * then migrates, e.g. to another thread). Both stacks must have been created
+ * with the same capacity and flags, without SP_STACK_ARENA or
+ * SP_STACK_SHARED.
+ *
+ * @param stack The stack adopting the context
+ * @param ctx An unregistered, unfinished coroutine context
+ * @warning The coroutine still sees the sp_stack it was created with as its
+ * argument; migrated coroutines must not use it to yield
+ */
+extern void register_ctx(sp_stack stack, sp_ctx ctx);
+
+/**
+ * @brief Destroy a coroutine context
+ *
+ * The context and its stack are kept in the pool of the owning stack and
+ * reused by the next create_ctx (see set_pool_watermarks).
+ *
+ * @param ctx The coroutine context to destroy
+ * @warning Cannot destroy the main context or a non-finished context
+ * @warning Must be called before deinit_stack on the owning stack
+ */
+extern void destroy_ctx(sp_ctx ctx);
+
+/**
+ * @brief Let a coroutine context be destroyed automatically once finished
+ *
+ * A detached context is handed back to the pool of its stack as soon as the
+ * stack has switched off it: finished detached contexts are queued on a
+ * deferred list drained by the next switch_ctx, yield_ctx or create_ctx of
+ * the stack. Detaching a finished context destroys it right away.
+ *
+ * @param ctx The coroutine context to detach (may be the current one)
+ * @warning The handle must not be used after detach_ctx (it may be recycled)
+ */
+extern void detach_ctx(sp_ctx ctx);
+
+/**
+ * @brief Configure the pool of destroyed contexts kept by a stack
+ *
+ * Destroyed contexts keep their stack mapping and are reused by create_ctx.
+ * Once the pool holds more than `high` contexts it is trimmed down to `low`.
+ *
+ * @param stack The stack owning the pool
+ * @param low Number of contexts kept after a trim
+ * @param high Number of pooled contexts that triggers a trim
+ */
+extern void set_pool_watermarks(sp_stack stack, size_t low, size_t high);
+
+/**
+ * @brief Release pooled contexts until at most `keep` remain
+ * @param stack The stack owning the pool
+ * @param keep Number of contexts to keep in the pool
+ * @return Number of released contexts
+ */
+extern size_t trim_pool(sp_stack stack, size_t keep);
+
+/**
+ * @brief Fill the pool with freshly mapped contexts ahead of a burst
+ *
+ * The next create_ctx calls take these contexts without a syscall, and their
+ * stacks are pre-faulted if set_stack_prefault was called first. A pool
+ * filled above the high watermark is trimmed by the next destroy_ctx.
+ *
+ * @param stack The stack owning the pool (not SP_STACK_SHARED)
+ * @param count Number of contexts the pool should hold
+ * @return Number of contexts mapped
+ */
+extern size_t prewarm_pool(sp_stack stack, size_t count);
+
+/**
+ * @brief Pre-fault the top of every stack mapped from now on
+ *
+ * The top `bytes` of each new stack (including lazy stacks when they are
+ * mapped, and prewarm_pool stacks) are populated at creation, so that the
+ * first resumes of a coroutine take no page fault. Uses
+ * MADV_POPULATE_WRITE where available, otherwise touches each page. On a
+ * SP_STACK_SHARED stack the shared stack is faulted in right away.
+ *
+ * @param stack The stack whose new coroutine stacks are pre-faulted
+ * @param bytes Depth below the stack top to fault in (0 disables)
+ */
+extern void set_stack_prefault(sp_stack stack, size_t bytes);
+
+/**
+ * @brief Release the stack pages of contexts idle for at least `idle_ns`
+ *
+ * Suspended coroutines that have not run for `idle_ns` get the pages below
+ * their saved stack pointer released (they are faulted back in, zeroed, if
+ * the coroutine goes deep again), and pooled stacks idle that long get all
+ * but their top page released. Idle time is tracked in passes of this
+ * function: a context counts as idle from the first pass that finds it has
+ * not run since the previous one, so call it periodically, e.g. every
+ * `idle_ns / 2`. Released pages are only counted (and advised) once until
+ * the context runs again. No effect on SP_STACK_SHARED stacks.
+ *
+ * @param stack The stack to scavenge (from its own thread)
+ * @param idle_ns Idle time in nanoseconds after which pages are released
+ * @return Bytes of resident memory released by this pass
+ */
+extern size_t scavenge_stack(sp_stack stack, uint64_t idle_ns);
+
+/**
+ * @brief Get the bytes released by scavenge_stack over the stack lifetime
+ */
+extern size_t get_scavenged_bytes(sp_stack stack);
+
+/**
+ * @brief Check if a coroutine context has finished execution
+ * @param ctx The coroutine context to check
+ * @return true if the coroutine has finished, false otherwise
+ */
+extern bool is_ctx_finished(sp_ctx ctx);
+
+/**
+ * Scheduling half of a context switch: where to save the stack pointer of the
+ * current context and the stack pointer to resume. `save` is NULL when the
+ * current context keeps running.
+ */
+struct sp_switch {
+  void **save;
+  void *rsp;
+};
+
+/**
+ * @brief Pick the context resumed by switch_ctx and update the run queue
+ * @param value Value handed to `ctx` (see transfer_ctx)
+ * @warning Internal, the switch must be completed right away
+ */
+extern struct sp_switch _prepare_switch_ctx(sp_stack stack, sp_ctx ctx,
+                                            void *value);
+
+/**
+ * @brief Pick the context resumed by yield_ctx and update the run queue
+ * @warning Internal, the switch must be completed right away
+ */
+extern struct sp_switch _prepare_yield_ctx(sp_stack stack);
+
+#if defined(__x86_64__)
+// The switch is inlined at the call site: the scheduling is done in C, then
+// the jump saves a resume address and swaps the stack pointer. Every general
+// purpose and vector register is declared clobbered, so the compiler only
+// spills what is live across the switch instead of a fixed register set.
+#define SP_INLINE_SWITCH
+
+// With AVX-512 the compiler may also keep values in xmm16-31 and in the mask
+// registers across the switch, so they are clobbered too
+#ifdef __AVX512F__
+#define SP_SWITCH_AVX512_CLOBBERS                                             \
+  , "xmm16", "xmm17", "xmm18", "xmm19", "xmm20", "xmm21", "xmm22", "xmm23",   \
+      "xmm24", "xmm25", "xmm26", "xmm27", "xmm28", "xmm29", "xmm30", "xmm31", \
+      "k0", "k1", "k2", "k3", "k4", "k5", "k6", "k7"
+#else
+#define SP_SWITCH_AVX512_CLOBBERS
+#endif // __AVX512F__
+
+/**
+ * @brief Save the current stack pointer to `sw.save` and resume `sw.rsp`
+ * @param value Handed to the resumed context in rax
+ * @return The value handed back by whoever resumes us
+ */
+static inline __attribute__((always_inline)) void *
+_jump_ctx(struct sp_switch sw, void *value) {
+  if (sw.save == NULL)
+    return value;
+
+  void **save = sw.save;
+  void *rsp = sw.rsp;
+
+  // The red zone of the caller is skipped before pushing, and rbp is saved
+  // by hand as it cannot be clobbered when used as the frame pointer
+  __asm__ volatile("leaq -128(%%rsp), %%rsp\n\t"
+                   "pushq %%rbp\n\t"
+                   "leaq 1f(%%rip), %%rcx\n\t"
+                   "pushq %%rcx\n\t"
+                   "movq %%rsp, (%0)\n\t"
+                   "movq %1, %%rsp\n\t"
+                   "popq %%rcx\n\t"
+                   "jmp *%%rcx\n"
+                   "1:\n\t"
+                   "popq %%rbp\n\t"
+                   "leaq 128(%%rsp), %%rsp"
+                   : "+D"(save), "+S"(rsp), "+a"(value)
+                   :
+                   : "rbx", "rcx", "rdx", "r8", "r9", "r10", "r11",
+                     "r12", "r13", "r14", "r15", "xmm0", "xmm1", "xmm2",
+                     "xmm3", "xmm4", "xmm5", "xmm6", "xmm7", "xmm8", "xmm9",
+                     "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15",
+                     "memory", "cc" SP_SWITCH_AVX512_CLOBBERS);
+  return value;
+}
+
+/**
+ * @brief Switch to the given coroutine context
+ * @param ctx The coroutine context to switch to (NULL for main context)
+ */
+static inline void switch_ctx(sp_stack stack, sp_ctx ctx) {
+  _jump_ctx(_prepare_switch_ctx(stack, ctx, NULL), NULL);
+}
+
+/**
+ * @brief Switch to the given coroutine context, handing it a value
+ *
+ * `value` is returned by the transfer_ctx call that suspended `ctx` (it is
+ * dropped if `ctx` was suspended otherwise or has not started yet). Values
+ * are carried in a register, not copied through memory.
+ *
+ * @param ctx The coroutine context to switch to (NULL for main context)
+ * @param value Value handed to `ctx`
+ * @return The value handed by the context that resumes us (NULL if resumed
+ * by switch_ctx, yield_ctx or a finishing coroutine)
+ */
+static inline void *transfer_ctx(sp_stack stack, sp_ctx ctx, void *value) {
+  return _jump_ctx(_prepare_switch_ctx(stack, ctx, value), value);
+}
+
+/**
+ * @brief Yield execution from the current coroutine context back to the caller
+ */
+static inline void yield_ctx(sp_stack stack) {
+  _jump_ctx(_prepare_yield_ctx(stack), NULL);
+}
+#else
+/**
+ * @brief Switch to the given coroutine context
+ * @param ctx The coroutine context to switch to (NULL for main context)
+ */
+extern void switch_ctx(sp_stack stack, sp_ctx ctx);
+
+/**
+ * @brief Switch to the given coroutine context, handing it a value
+ *
+ * `value` is returned by the transfer_ctx call that suspended `ctx` (it is
+ * dropped if `ctx` was suspended otherwise or has not started yet). Values
+ * are carried in a register, not copied through memory.
+ *
+ * @param ctx The coroutine context to switch to (NULL for main context)
+ * @param value Value handed to `ctx`
+ * @return The value handed by the context that resumes us (NULL if resumed
+ * by switch_ctx, yield_ctx or a finishing coroutine)
+ */
+extern void *transfer_ctx(sp_stack stack, sp_ctx ctx, void *value);
+
+/**
+ * @brief Yield execution from the current coroutine context back to the caller
+ */
+extern void yield_ctx(sp_stack stack);
+#endif // __x86_64__
+
+/**
+ * @brief Suspend the current context until unpark_ctx is called on it
+ *
+ * A parked context is not visited by yield_ctx, so waiting costs nothing to
+ * the other coroutines. switch_ctx on a parked context also wakes it up.
+ *
+ * @param stack The stack of the current context
+ * @warning Parking while no other context is runnable is a deadlock, unless
+ * a context waits on a timer (the thread then sleeps until it expires)
+ */
+extern void park_ctx(sp_stack stack);
+
+/**
+ * @brief Make a parked context runnable again
+ *
+ * The context is queued at the tail of the run queue. Does nothing if the
+ * context is not parked.
+ *
+ * @param stack The stack of the context
+ * @param ctx The context to wake up (NULL for main context)
+ */
+extern void unpark_ctx(sp_stack stack, sp_ctx ctx);
+
+/**
+ * @brief Park the current context until unparked or until a deadline
+ *
+ * Timers live in a hierarchical timing wheel of the stack, with O(1)
+ * insertion and cancellation and a resolution of 2^TIMER_TICK_SHIFT ns
+ * (~1 ms); they never fire early. While timers are pending, yield_ctx
+ * advances the wheel with one clock read per pass over the run queue, and
+ * the thread sleeps until the next expiry when every context is parked.
+ *
+ * @param stack The stack of the current context
+ * @param deadline Time in get_time_ns nanoseconds
+ * @return false if the deadline passed (returns at once if it already had)
+ */
+extern bool park_ctx_until(sp_stack stack, uint64_t deadline);
+
+/**
+ * @brief Suspend the current context for a duration
+ *
+ * The context is parked on a timer (see park_ctx_until), so sleepers stay
+ * out of the run queue. Spurious unpark_ctx are ignored.
+ *
+ * @param stack The stack of the current context
+ * @param ns Nanoseconds to sleep at least
+ */
+extern void sleep_ctx(sp_stack stack, uint64_t ns);
+
+/**
+ * @brief Read the monotonic clock used by timers
+ * @return Time in nanoseconds
+ */
+extern uint64_t get_time_ns(void);
+
+// Timeout of a poller that may block until an event arrives
+#define SP_POLL_FOREVER UINT64_MAX
+
+/**
+ * Event source polled by the scheduler of a stack (see set_stack_poller).
+ * It makes the contexts waiting on ready events runnable (unpark_ctx) and
+ * returns whether events are still pending. With a timeout of 0 it must not
+ * block; otherwise it may block for that many nanoseconds (or SP_POLL_FOREVER)
+ * until an event arrives, but only if it has events pending.
+ */
+typedef bool (*sp_poll_func)(sp_stack stack, void *arg, uint64_t timeout_ns);
+
+/**
+ * @brief Plug an event source into the scheduler of a stack
+ *
+ * yield_ctx polls it without blocking once per pass over the run queue,
+ * together with the timers. When every context is parked, the thread blocks
+ * in it until the next timer expires instead of sleeping.
+ *
+ * @param stack The stack to poll for
+ * @param fn The poller (NULL to remove it), one per stack
+ * @param arg Argument given to fn
+ */
+extern void set_stack_poller(sp_stack stack, sp_poll_func fn, void *arg);
+
+/**
+ * @brief Get a pointer to the current coroutine context
+ * @return Pointer to the current coroutine context (NULL for main context)
+ */
+extern sp_ctx get_ctx(sp_stack stack);
+
+/**
+ * @brief Set the result of the current context
+ *
+ * The result is returned by await_ctx and get_ctx_result once the context
+ * has finished (NULL if never set).
+ *
+ * @param stack The stack of the current context
+ * @param result The result value
+ */
+extern void set_ctx_result(sp_stack stack, void *result);
+
+/**
+ * @brief Get the result of a finished context
+ * @param ctx A finished coroutine context (before destroy_ctx)
+ * @return The value given to set_ctx_result (NULL if never set)
+ */
+extern void *get_ctx_result(sp_ctx ctx);
+
+/**
+ * @brief Get the peak stack usage of a coroutine
+ *
+ * Readable while the context runs or is suspended, and after it finished
+ * (until destroy_ctx). With SP_STACK_SHARED only the frames live at switch
+ * points are known per context, so the value is a lower bound (see
+ * stack_high_water for the shared stack itself). Stack memory given through
+ * sp_ctx_attr.stack is zeroed by create_ctx_ex on such stacks, so that only
+ * the bytes this context writes are counted.
+ *
+ * @param ctx The coroutine context (of a stack created with
+ * SP_STACK_HIGH_WATER)
+ * @return Peak number of stack bytes used
+ */
+extern size_t ctx_stack_high_water(sp_ctx ctx);
+
+/**
+ * @brief Get the peak stack usage over the coroutines of a stack
+ * @param stack A stack created with SP_STACK_HIGH_WATER
+ * @return Largest peak of its live and destroyed coroutines (peak usage of
+ * the shared stack with SP_STACK_SHARED)
+ */
+extern size_t stack_high_water(sp_stack stack);
+
+/**
+ * @brief Suspend the current context until `ctx` finishes
+ *
+ * The caller is parked, so it costs nothing to the scheduler while waiting.
+ * When `ctx` returns, coroutine_finish resumes the most recent waiter right
+ * away and queues the others. Returns immediately if `ctx` already finished.
+ *
+ * @param stack The stack of the current context and of `ctx`
+ * @param ctx The context to wait for (not the current or main context)
+ * @return The result of `ctx` (see set_ctx_result)
+ * @warning `ctx` must still be destroyed with destroy_ctx, by a single owner
+ */
+extern void *await_ctx(sp_stack stack, sp_ctx ctx);
+
+/*
+ * Generators
+ *
+ * A generator is a coroutine that only runs when its consumer asks for the
+ * next value. Values are handed over by pointer (no copy) through
+ * transfer_ctx, so they must stay valid until the next gen_next call. With
+ * SP_STACK_SHARED, a pointer into the generator stack can only be read by a
+ * consumer that does not run on the shared stack (e.g. main).
+ */
+
+/**
+ * @brief Create a generator on the given stack
+ *
+ * The generator does not run until the first gen_next and is never resumed
+ * by yield_ctx. Its coroutine stack returns to the pool of `stack` as soon as
+ * the iteration finishes.
+ *
+ * @param stack Stack of the consumer
+ * @param fn The generator function
+ * @param arg The argument to the generator function
+ * @return Generator object
+ */
+extern sp_gen gen_create(sp_stack stack, sp_gen_func fn, void *arg);
+
+/**
+ * @brief Run the generator until it yields its next value
+ * @param gen The generator
+ * @return The value given to gen_yield, or NULL once the generator returned
+ */
+extern void *gen_next(sp_gen gen);
+
+/**
+ * @brief Hand a value to the consumer and wait for the next gen_next
+ * @param gen The generator (must be called from its own function)
+ * @param value The value returned by gen_next (must not be NULL)
+ */
+extern void gen_yield(sp_gen gen, void *value);
+
+/**
+ * @brief Check if a generator has returned
+ * @param gen The generator to check
+ * @return true once gen_next returned NULL
+ */
+extern bool is_gen_finished(sp_gen gen);
+
+/**
+ * @brief Destroy a generator
+ *
+ * A generator that has not finished is dropped where it is suspended: its
+ * function never resumes, so what it allocated and would free after its
+ * next gen_yield leaks.
+ *
+ * @param gen The generator to destroy
+ * @warning Not while a gen_next on it is in progress
+ */
+extern void gen_destroy(sp_gen gen);
+
+/*
+ * Channels
+ *
+ * A channel passes void * values between the coroutines of one sp_stack, in
+ * FIFO order. Blocked senders and receivers are parked (not polled) in FIFO
+ * order too. A send to a parked receiver hands the value over directly and
+ * switches to the receiver, without going through the buffer.
+ */
+
+/**
+ * @brief Create a channel
+ * @param stack The stack whose coroutines use the channel
+ * @param capacity Values buffered before senders park: 0 makes every send
+ * wait for a receiver, SP_CHAN_UNBOUNDED never parks senders
+ * @return Channel object
+ */
+extern sp_chan chan_create(sp_stack stack, size_t capacity);
+
+/**
+ * @brief Free a channel
+ * @warning No context may be parked on the channel
+ */
+extern void chan_destroy(sp_chan chan);
+
+/**
+ * @brief Send a value, parking while the channel is full
+ * @return false if the channel is closed (before or while parked)
+ */
+extern bool chan_send(sp_chan chan, void *value);
+
+/**
+ * @brief Receive a value, parking while the channel is empty
+ * @param value Set to the received value (NULL once closed and drained)
+ * @return false once the channel is closed and drained
+ */
+extern bool chan_recv(sp_chan chan, void **value);
+
+/**
+ * @brief Close a channel
+ *
+ * Parked senders and receivers are woken up and fail, as do later sends.
+ * Buffered values can still be received.
+ */
+extern void chan_close(sp_chan chan);
+
+/**
+ * @brief Check if a channel was closed
+ */
+extern bool is_chan_closed(sp_chan chan);
+
+/**
+ * @brief Get the number of buffered values
+ */
+extern size_t chan_len(sp_chan chan);
+
+/**
+ * One operation of a chan_select
+ */
+typedef struct sp_chan_case {
+  sp_chan chan;
+  // true to send value, false to receive into it
+  bool send;
+  // Value to send, or value received (NULL if the channel closed)
+  void *value;
+  // Set by chan_select on the completed case: false if the channel closed
+  bool ok;
+} sp_chan_case;
+
+/**
+ * @brief Wait on several channel operations and complete exactly one
+ *
+ * Cases that can complete right away are tried in order, so earlier cases
+ * take priority. Otherwise the current context parks on every channel at
+ * once; the first case completed by another coroutine (or by chan_close)
+ * wakes it and withdraws the others, in O(count).
+ *
+ * @param cases Operations on channels of the same stack
+ * @param count Number of cases (at least 1)
+ * @param block If false, return -1 instead of parking
+ * @return Index of the completed case, or -1
+ */
+extern int chan_select(sp_chan_case *cases, size_t count, bool block);
+
+/**
+ * @brief chan_select that gives up at a deadline
+ *
+ * The current context parks on a timer as well as on the channels (see
+ * park_ctx_until); on timeout, every case is withdrawn.
+ *
+ * @param deadline Time in get_time_ns nanoseconds
+ * @return Index of the completed case, or -1 once the deadline passed
+ */
+extern int chan_select_until(sp_chan_case *cases, size_t count,
+                             uint64_t deadline);
+
+/*
+ * Mutexes, condition variables and semaphores
+ *
+ * Synchronize the coroutines of one sp_stack. Blocked contexts are parked in
+ * FIFO order and woken one at a time, never polled. Wakeups hand over what
+ * was waited for: mutex_unlock passes the mutex to the oldest waiter,
+ * sema_release passes its unit, and a signaled cond_wait is queued on the
+ * mutex instead of waking up to compete for it. Semaphore functions use a
+ * sema_ prefix, as sem_* names belong to POSIX semaphores.
+ */
+
+/**
+ * @brief Create a mutex
+ * @param stack The stack whose coroutines use the mutex
+ */
+extern sp_mutex mutex_create(sp_stack stack);
+
+/**
+ * @brief Free a mutex
+ * @warning The mutex must be unlocked
+ */
+extern void mutex_destroy(sp_mutex mutex);
+
+/**
+ * @brief Lock a mutex, parking while another context holds it
+ */
+extern void mutex_lock(sp_mutex mutex);
+
+/**
+ * @brief Lock a mutex if it is free
+ * @return Whether the mutex was locked
+ */
+extern bool mutex_try_lock(sp_mutex mutex);
+
+/**
+ * @brief Unlock a mutex held by the current context
+ *
+ * The oldest parked context, if any, becomes the owner and is made
+ * runnable.
+ */
+extern void mutex_unlock(sp_mutex mutex);
+
+/**
+ * @brief Create a condition variable
+ * @param stack The stack whose coroutines use the condition variable
+ */
+extern sp_cond cond_create(sp_stack stack);
+
+/**
+ * @brief Free a condition variable
+ *
+ * Contexts already signaled but still waiting for the mutex do not use the
+ * condition anymore: it may be destroyed right after cond_broadcast.
+ *
+ * @warning No context may be waiting on it
+ */
+extern void cond_destroy(sp_cond cond);
+
+/**
+ * @brief Unlock a mutex and park until signaled, then own the mutex again
+ * @param mutex Mutex held by the current context, the same for all waiters
+ */
+extern void cond_wait(sp_cond cond, sp_mutex mutex);
+
+/**
+ * @brief Wake the oldest waiter of a condition variable, if any
+ */
+extern void cond_signal(sp_cond cond);
+
+/**
+ * @brief Wake every waiter of a condition variable, in order
+ */
+extern void cond_broadcast(sp_cond cond);
+
+/**
+ * @brief Create a counting semaphore
+ * @param stack The stack whose coroutines use the semaphore
+ * @param count Initial number of units
+ */
+extern sp_sem sema_create(sp_stack stack, size_t count);
+
+/**
+ * @brief Free a semaphore
+ * @warning No context may be waiting on it
+ */
+extern void sema_destroy(sp_sem sem);
+
+/**
+ * @brief Take a unit, parking while none is available
+ */
+extern void sema_acquire(sp_sem sem);
+
+/**
+ * @brief Take a unit if one is available
+ * @return Whether a unit was taken
+ */
+extern bool sema_try_acquire(sp_sem sem);
+
+/**
+ * @brief Give a unit back, to the oldest parked context if any
+ */
+extern void sema_release(sp_sem sem);
+
+/**
+ * @brief Get the number of available units
+ */
+extern size_t sema_count(sp_sem sem);
+
+#ifdef __linux__
+/*
+ * I/O reactor (Linux only)
+ *
+ * A reactor runs the I/O of the coroutines of one sp_stack on an io_uring
+ * instance. co_* functions queue a submission entry and park the calling
+ * context; the scheduler submits everything queued during a pass over the
+ * run queue with a single io_uring_enter, and resumes each context with its
+ * completion. When every context waits, the thread blocks in io_uring_enter
+ * until a completion arrives or the next timer expires.
+ *
+ * Results follow io_uring: the value of the matching system call, or a
+ * negative errno. Buffers and addresses are used by the kernel while the
+ * context is parked, so on a SP_STACK_SHARED stack they must not live on
+ * the coroutine stack.
+ */
+
+/**
+ * @brief Create a reactor and plug it into the scheduler of a stack
+ * @param stack The stack whose coroutines do I/O (one reactor per stack)
+ * @param entries Submission queue size (if 0, use default REACTOR_ENTRIES)
+ * @return Reactor object, or NULL if io_uring (Linux 5.11+) is unavailable
+ */
+extern sp_reactor reactor_create(sp_stack stack, unsigned entries);
+
+/**
+ * @brief Unplug and free a reactor
+ * @warning No operation may be pending
+ */
+extern void reactor_destroy(sp_reactor reactor);
+
+/**
+ * @brief Get the number of io_uring_enter calls made so far
+ */
+extern size_t reactor_enter_count(sp_reactor reactor);
+
+/**
+ * @brief Get the number of io_uring_enter calls that submitted operations
+ * (the others only waited for completions)
+ */
+extern size_t reactor_submit_count(sp_reactor reactor);
+
+/**
+ * @brief Read from a file descriptor, parking until done
+ * @param offset File offset, or -1 for the current position (sockets, pipes)
+ * @return Bytes read, or a negative errno
+ */
+extern ssize_t co_read(sp_reactor reactor, int fd, void *buf, size_t len,
+                       off_t offset);
+
+/**
+ * @brief Write to a file descriptor, parking until done
+ * @param offset File offset, or -1 for the current position (sockets, pipes)
+ * @return Bytes written, or a negative errno
+ */
+extern ssize_t co_write(sp_reactor reactor, int fd, const void *buf,
+                        size_t len, off_t offset);
+
+/**
+ * @brief Accept a connection, parking until one arrives
+ * @param addr Peer address (may be NULL)
+ * @param addrlen Size of addr, updated to the address length
+ * @return Connected socket, or a negative errno
+ */
+extern int co_accept(sp_reactor reactor, int fd, struct sockaddr *addr,
+                     socklen_t *addrlen);
+
+/**
+ * @brief Connect a socket, parking until connected
+ * @return 0, or a negative errno
+ */
+extern int co_connect(sp_reactor reactor, int fd, const struct sockaddr *addr,
+                      socklen_t addrlen);
+
+/**
+ * @brief Flush a file to storage, parking until done
+ * @return 0, or a negative errno
+ */
+extern int co_fsync(sp_reactor reactor, int fd);
+#endif // __linux__
+
+/*
+ * Multi-threaded runtime
+ *
+ * A runtime owns worker threads, each driving its own sp_stack. Runnable
+ * tasks sit in per-worker work-stealing deques (Chase-Lev): a worker runs
+ * its own tasks first, then tasks spawned from outside the runtime, then
+ * steals from the other workers. A task that yields may be resumed by
+ * another worker, so tasks must not rely on thread-local state across
+ * yield_task.
+ */
+
+/**
+ * @brief Start a runtime
+ * @param workers Number of worker threads
+ * @param stack_capacity Stack capacity of the tasks (if 0, use default
+ * STACK_CAPACITY)
+ * @return Runtime object
+ */
+extern sp_runtime init_runtime(size_t workers, size_t stack_capacity);
+
+/**
+ * @brief Wait for every task, then stop the workers and free the runtime
+ * @param rt The runtime to tear down
+ */
+extern void deinit_runtime(sp_runtime rt);
+
+/**
+ * @brief Spawn a task on the runtime
+ *
+ * Called from a task, the new task is pushed on the current worker's deque;
+ * otherwise it goes through a shared injection queue.
+ *
+ * @param rt The runtime
+ * @param fn The task function
+ * @param arg The argument to pass to the task function
+ */
+extern void spawn_task(sp_runtime rt, sp_task_func fn, void *arg);
+
+/**
+ * @brief Yield the current task back to its worker
+ *
+ * The task is requeued on the worker's deque, where other workers may steal
+ * it and resume it on their thread.
+ *
+ * @param rt The runtime running the current task
+ */
+extern void yield_task(sp_runtime rt);
+
+/**
+ * @brief Block the calling thread until every spawned task has finished
+ * @param rt The runtime
+ * @warning Must not be called from a task
+ */
+extern void wait_runtime(sp_runtime rt);
+
+/**
+ * @brief Get the index of the worker running the current task
+ * @param rt The runtime running the current task
+ * @return Worker index in [0, workers)
+ */
+extern size_t runtime_worker_id(sp_runtime rt);
+
+/**
+ * @brief Set the idle time after which workers release stack pages
+ *
+ * Each worker calls scavenge_stack on its own stack every `idle_ns / 2`
+ * (checked every few hundred tasks while busy, and on a timer while idle),
+ * so the stacks of pooled contexts of finished tasks stop holding memory
+ * once the runtime goes quiet. Defaults to RUNTIME_SCAVENGE_IDLE_NS (1 s).
+ *
+ * @param rt The runtime
+ * @param idle_ns Idle time in nanoseconds (0 disables scavenging)
+ */
+extern void set_runtime_scavenge(sp_runtime rt, uint64_t idle_ns);
+
+/**
+ * @brief Get the bytes released by the scavenge passes of all workers
+ * @param rt The runtime
+ */
+extern size_t runtime_scavenged_bytes(sp_runtime rt);
+
+#endif // _COROUTINE_H
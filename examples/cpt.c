@@ -23,9 +23,8 @@ int main() {
     sp_ctx ctx2 = create_ctx(stack, (void*) cpt, (void*)(size_t)25);
 
 
-    while (!is_ctx_finished(ctx1) || !is_ctx_finished(ctx2)) {
-        yield_ctx(stack);
-    }
+    await_ctx(stack, ctx1);
+    await_ctx(stack, ctx2);
 
     destroy_ctx(ctx1);
     destroy_ctx(ctx2);
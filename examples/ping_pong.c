@@ -35,9 +35,8 @@ int main(void) {
 
     switch_ctx(stack, ping_ctx);
 
-    while (!is_ctx_finished(ping_ctx) || !is_ctx_finished(pong_ctx)) {
-        yield_ctx(stack);
-    }
+    await_ctx(stack, ping_ctx);
+    await_ctx(stack, pong_ctx);
 
     destroy_ctx(ping_ctx);
     destroy_ctx(pong_ctx);
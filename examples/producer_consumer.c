@@ -1,78 +1,57 @@
 #include <stdio.h>
-#include <stdbool.h>
 #include "coroutine.h"
 
 #define BUFFER_CAP 4
+#define ITEMS 12
 
-static int buffer[BUFFER_CAP];
-static size_t head = 0;
-static size_t tail = 0;
-static size_t count = 0;
-static bool producer_done = false;
+// The producer parks while the channel holds BUFFER_CAP values, the consumer
+// while it is empty; closing the channel ends the consumer loop.
 
-static void enqueue(int value) {
-    buffer[tail] = value;
-    tail = (tail + 1) % BUFFER_CAP;
-    count++;
-}
-
-static int dequeue(void) {
-    int value = buffer[head];
-    head = (head + 1) % BUFFER_CAP;
-    count--;
-    return value;
-}
+struct production {
+    sp_chan chan;
+    size_t limit; // Values to produce
+};
 
 void producer(sp_stack stack, void* arg) {
-    int limit = (int)(size_t)arg;
+    struct production* p = arg;
+    sp_chan chan = p->chan;
 
-    for (int i = 1; i <= limit; i++) {
-        while (count == BUFFER_CAP) {
-            yield_ctx(stack);
-        }
-
-        enqueue(i);
-        printf("[producer | ctx %p] produced %d (count=%zu)\n", get_ctx(stack), i, count);
+    for (size_t i = 1; i <= p->limit; i++) {
+        chan_send(chan, (void*)i);
+        printf("[producer | ctx %p] produced %zu (count=%zu)\n", get_ctx(stack), i, chan_len(chan));
         fflush(stdout);
-
-        yield_ctx(stack);
     }
 
-    producer_done = true;
-    yield_ctx(stack);
+    chan_close(chan);
 }
 
 void consumer(sp_stack stack, void* arg) {
-    (void)arg;
+    sp_chan chan = arg;
+    void* value;
 
-    while (!producer_done || count > 0) {
-        if (count == 0) {
-            yield_ctx(stack);
-            continue;
-        }
-
-        int value = dequeue();
-        printf("[consumer | ctx %p] consumed %d (count=%zu)\n", get_ctx(stack), value, count);
+    while (chan_recv(chan, &value)) {
+        printf("[consumer | ctx %p] consumed %zu (count=%zu)\n", get_ctx(stack), (size_t)value, chan_len(chan));
         fflush(stdout);
-
-        yield_ctx(stack);
     }
 }
 
 int main(void) {
 
     sp_stack stack = init_stack(16384);
+    sp_chan chan = chan_create(stack, BUFFER_CAP);
 
-    sp_ctx producer_ctx = create_ctx(stack, producer, (void*)(size_t)12);
-    sp_ctx consumer_ctx = create_ctx(stack, consumer, NULL);
+    struct production production = {chan, ITEMS};
 
-    while (!is_ctx_finished(producer_ctx) || !is_ctx_finished(consumer_ctx)) {
-        yield_ctx(stack);
-    }
+    sp_ctx producer_ctx = create_ctx(stack, producer, &production);
+    sp_ctx consumer_ctx = create_ctx(stack, consumer, chan);
+
+    await_ctx(stack, producer_ctx);
+    await_ctx(stack, consumer_ctx);
 
     destroy_ctx(producer_ctx);
     destroy_ctx(consumer_ctx);
 
+    chan_destroy(chan);
     deinit_stack(stack);
 
     return 0;
@@ -6,6 +6,7 @@
 
 #define EXAMPLE_DIR "examples/"
 #define TEST_DIR "tests/"
+#define BENCH_DIR "bench/"
 #define SRC_DIR "src/"
 #define BUILD_DIR "build/"
 
@@ -30,6 +31,9 @@
 #define LINK_FLAGS "-l:" STATIC_LIB_NAME
 #endif
 
+// Libraries needed by the coroutine library (runtime worker threads)
+#define LIB_DEPS "-lpthread"
+
 #define WARNING_FLAGS(cmd) cmd_append(cmd, "-Wall", "-Wextra", "-Wpedantic");
 
 Cmd cmd = {};
@@ -43,12 +47,24 @@ bool create_library(bool dbg) {
 
   const char *sources[] = {
       SRC_DIR "coroutine.c",
+      SRC_DIR "runtime.c",
+      SRC_DIR "channel.c",
+      SRC_DIR "sync.c",
+#ifdef __linux__
+      SRC_DIR "io.c", // io_uring reactor
+#endif
       SRC_DIR ARCH_DIR "asm.s",
       SRC_DIR ARCH_DIR "platform.c",
   };
 
   const char *objects[] = {
       BUILD_DIR "coroutine.o",
+      BUILD_DIR "runtime.o",
+      BUILD_DIR "channel.o",
+      BUILD_DIR "sync.o",
+#ifdef __linux__
+      BUILD_DIR "io.o",
+#endif
       BUILD_DIR "asm.o",
       BUILD_DIR "platform.o",
   };
@@ -76,8 +92,9 @@ bool create_library(bool dbg) {
     return false;
 
   // Create static library
-  cmd_append(&cmd, "ar", "rcs", BUILD_DIR STATIC_LIB_NAME, objects[0],
-             objects[1], objects[2]);
+  cmd_append(&cmd, "ar", "rcs", BUILD_DIR STATIC_LIB_NAME);
+  for (size_t i = 0; i < NOB_ARRAY_LEN(objects); i++)
+    cmd_append(&cmd, objects[i]);
 
   if (!cmd_run(&cmd))
     return false;
@@ -122,7 +139,7 @@ bool build_test(char *name, bool debug, bool run) {
 
   cmd_append(&cmd, source_path.items);
   cmd_append(&cmd, "-L", LIB_DIR "lib");
-  cmd_append(&cmd, LINK_FLAGS);
+  cmd_append(&cmd, LINK_FLAGS, LIB_DEPS);
   cmd_append(&cmd, "-o", exe_path.items);
 
   if (!cmd_run(&cmd))
@@ -157,7 +174,7 @@ bool build_example(char *name, bool debug) {
 
   cmd_append(&cmd, source_path.items);
   cmd_append(&cmd, "-L", LIB_DIR "lib");
-  cmd_append(&cmd, LINK_FLAGS);
+  cmd_append(&cmd, LINK_FLAGS, LIB_DEPS);
   cmd_append(&cmd, "-o", exe_path.items);
 
   if (!cmd_run(&cmd))
@@ -168,21 +185,64 @@ bool build_example(char *name, bool debug) {
   return true;
 }
 
+bool build_bench(char *name, bool debug) {
+  if (!mkdir_if_not_exists(BUILD_DIR "bench/"))
+    return false;
+
+  cmd_append(&cmd, "cc");
+  WARNING_FLAGS(&cmd);
+
+  if (debug)
+    cmd_append(&cmd, "-g");
+  else
+    cmd_append(&cmd, "-O3");
+
+  cmd_append(&cmd, "-I", LIB_DIR "include");
+  cmd_append(&cmd, "-I", BENCH_DIR);
+  String_Builder source_path = {};
+  String_Builder exe_path = {};
+
+  nob_sb_appendf(&source_path, BENCH_DIR "%s.c", name);
+  nob_sb_appendf(&exe_path, BUILD_DIR "bench/%s", name);
+
+  cmd_append(&cmd, source_path.items);
+  cmd_append(&cmd, "-L", LIB_DIR "lib");
+  cmd_append(&cmd, LINK_FLAGS, LIB_DEPS);
+  cmd_append(&cmd, "-o", exe_path.items);
+
+  if (!cmd_run(&cmd))
+    return false;
+
+  nob_log(NOB_INFO, "Built benchmark: %s", exe_path.items);
+
+  return true;
+}
+
 void print_help() {
   nob_log(NOB_INFO, "Usage: build_tool [options] [example_name]");
   nob_log(NOB_INFO, "Options:");
   nob_log(NOB_INFO, "  -g, --debug       Build with debug symbols");
   nob_log(NOB_INFO, "  -r, --run         Run the example after building");
+  nob_log(NOB_INFO, "  -b, --bench       Build a benchmark from bench/ instead");
+  nob_log(NOB_INFO, "  --json FILE       (bench) Write the results as JSON lines");
+  nob_log(NOB_INFO, "  --baseline FILE   (bench) Compare against saved results");
+  nob_log(NOB_INFO, "  --threshold PCT   (bench) Allowed slowdown (default 10)");
   nob_log(NOB_INFO, "  -h, --help        Show this help message");
   nob_log(NOB_INFO, "");
   nob_log(NOB_INFO,
           "If example_name is provided, the specified example will be built.");
   nob_log(NOB_INFO, "Use `tests` as the name to build and run all tests.");
+  nob_log(NOB_INFO, "Use `bench` as the name to build all benchmarks and run "
+                    "the microbenchmark suite.");
 }
 
 struct args {
   bool debug;
   bool run;
+  bool bench;
+  char *json;
+  char *baseline;
+  char *threshold;
   char *example_name;
 };
 
@@ -192,6 +252,10 @@ bool parse_args(struct args *args, int argc, char **argv) {
 
   args->debug = false;
   args->run = false;
+  args->bench = false;
+  args->json = NULL;
+  args->baseline = NULL;
+  args->threshold = NULL;
   args->example_name = NULL;
 
   for (int i = 1; i < argc; i++) {
@@ -199,6 +263,14 @@ bool parse_args(struct args *args, int argc, char **argv) {
       args->debug = true;
     } else if (check("--run") || check("-r")) {
       args->run = true;
+    } else if (check("--bench") || check("-b")) {
+      args->bench = true;
+    } else if (check("--json") && i + 1 < argc) {
+      args->json = argv[++i];
+    } else if (check("--baseline") && i + 1 < argc) {
+      args->baseline = argv[++i];
+    } else if (check("--threshold") && i + 1 < argc) {
+      args->threshold = argv[++i];
     } else if (check("--help") || check("-h")) {
       print_help();
       exit(0);
@@ -210,6 +282,40 @@ bool parse_args(struct args *args, int argc, char **argv) {
   return true;
 }
 
+bool run_benchmarks(struct args *args) {
+  Nob_File_Paths bench_files = {0};
+
+  if (!nob_read_entire_dir(BENCH_DIR, &bench_files))
+    return false;
+
+  // Build every benchmark so none of them bit-rots
+  for (size_t i = 0; i < bench_files.count; i++) {
+    const char *bench_file_raw = bench_files.items[i];
+    size_t len = strlen(bench_file_raw);
+
+    if (len < 3 || strcmp(bench_file_raw + len - 2, ".c") != 0)
+      continue; // not a .c file
+
+    char *bench_file = strdup(bench_file_raw);
+    bench_file[len - 2] = '\0'; // remove .c extension
+    bool built = build_bench(bench_file, args->debug);
+    free(bench_file);
+
+    if (!built)
+      return false;
+  }
+
+  cmd_append(&cmd, BUILD_DIR "bench/suite");
+  if (args->json != NULL)
+    cmd_append(&cmd, "--json", args->json);
+  if (args->baseline != NULL)
+    cmd_append(&cmd, "--baseline", args->baseline);
+  if (args->threshold != NULL)
+    cmd_append(&cmd, "--threshold", args->threshold);
+
+  return cmd_run(&cmd);
+}
+
 int main(int argc, char **argv) {
   NOB_GO_REBUILD_URSELF(argc, argv);
 
@@ -264,12 +370,18 @@ int main(int argc, char **argv) {
         nob_log(NOB_INFO, "All %zu tests passed", total_tests);
       }
 
+    } else if (strcmp(args.example_name, "bench") == 0) {
+      if (!run_benchmarks(&args))
+        return 1;
     } else {
-      if (!build_example(args.example_name, args.debug))
+      bool built = args.bench ? build_bench(args.example_name, args.debug)
+                              : build_example(args.example_name, args.debug);
+      if (!built)
         return 1;
       if (args.run) {
         String_Builder exe_path = {};
-        nob_sb_appendf(&exe_path, BUILD_DIR "%s", args.example_name);
+        nob_sb_appendf(&exe_path, BUILD_DIR "%s%s",
+                       args.bench ? "bench/" : "", args.example_name);
         cmd_append(&cmd, exe_path.items);
         if (!cmd_run(&cmd))
           return 1;
@@ -0,0 +1,389 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "coroutine.h"
+
+/* Private Types */
+
+// FIFO of parked contexts
+struct s_chan_queue {
+  struct s_chan_waiter *head;
+  struct s_chan_waiter *tail;
+};
+
+// Context parked on a channel. Waiters live on the heap rather than on the
+// parked coroutine's stack, whose frames are swapped out on a shared stack.
+struct s_chan_waiter {
+  sp_ctx ctx;  // Parked context (NULL for main context)
+  void *value; // Value to send, or value received
+  bool done;   // Completed by the other side (or by chan_close)
+  bool ok;     // false if completed by chan_close
+  struct s_chan_queue *queue; // Queue the waiter is parked in
+  struct s_chan_waiter *prev;
+  struct s_chan_waiter *next;
+  // Ring of the other waiters of the same chan_select (NULL otherwise),
+  // dequeued as soon as one of them is completed
+  struct s_chan_waiter *sibling;
+};
+
+struct s_chan {
+  sp_stack stack;
+  size_t capacity; // Buffered values before senders park
+  bool closed;
+
+  // Ring buffer, grown on demand up to capacity
+  void **items;
+  size_t size; // Allocated slots (0 or a power of two)
+  size_t head; // Index of the oldest value
+  size_t count;
+
+  struct s_chan_queue senders;
+  struct s_chan_queue receivers;
+  struct s_chan_waiter *free_waiters; // Recycled waiters
+};
+
+// Initial number of slots of a channel buffer
+#ifndef CHAN_INIT_SIZE
+#define CHAN_INIT_SIZE 16
+#endif // CHAN_INIT_SIZE
+
+// Deadline of a select that waits without timer
+#define NO_DEADLINE UINT64_MAX
+
+/* Private Functions */
+
+static void queue_push(struct s_chan_queue *queue,
+                       struct s_chan_waiter *waiter) {
+  waiter->queue = queue;
+  waiter->next = NULL;
+  waiter->prev = queue->tail;
+  if (queue->tail != NULL)
+    queue->tail->next = waiter;
+  else
+    queue->head = waiter;
+  queue->tail = waiter;
+}
+
+static void queue_remove(struct s_chan_queue *queue,
+                         struct s_chan_waiter *waiter) {
+  if (waiter->prev != NULL)
+    waiter->prev->next = waiter->next;
+  else
+    queue->head = waiter->next;
+
+  if (waiter->next != NULL)
+    waiter->next->prev = waiter->prev;
+  else
+    queue->tail = waiter->prev;
+}
+
+/**
+ * @brief Dequeue the oldest waiter, to be completed by the caller
+ *
+ * The other waiters of a chan_select are dequeued from their channels too,
+ * so a select completes at most one of its cases.
+ */
+static struct s_chan_waiter *queue_pop(struct s_chan_queue *queue) {
+  struct s_chan_waiter *waiter = queue->head;
+  if (waiter == NULL)
+    return NULL;
+
+  queue_remove(queue, waiter);
+
+  for (struct s_chan_waiter *other = waiter->sibling;
+       other != NULL && other != waiter; other = other->sibling)
+    queue_remove(other->queue, other);
+
+  return waiter;
+}
+
+static struct s_chan_waiter *waiter_get(sp_chan chan, void *value) {
+  struct s_chan_waiter *waiter = chan->free_waiters;
+  if (waiter != NULL) {
+    chan->free_waiters = waiter->next;
+  } else {
+    waiter = malloc(sizeof(*waiter));
+    assert(waiter != NULL && "Maybe you should buy more RAM");
+  }
+
+  waiter->ctx = get_ctx(chan->stack);
+  waiter->value = value;
+  waiter->done = false;
+  waiter->ok = false;
+  waiter->sibling = NULL;
+  return waiter;
+}
+
+static void waiter_put(sp_chan chan, struct s_chan_waiter *waiter) {
+  waiter->next = chan->free_waiters;
+  chan->free_waiters = waiter;
+}
+
+/**
+ * @brief Park the current context until its waiter is completed
+ * @return Whether the operation went through (false if the channel closed)
+ */
+static bool waiter_park(sp_chan chan, struct s_chan_queue *queue,
+                        struct s_chan_waiter *waiter) {
+  queue_push(queue, waiter);
+
+  // Spurious unpark_ctx are ignored
+  while (!waiter->done)
+    park_ctx(chan->stack);
+
+  return waiter->ok;
+}
+
+static void buffer_push(sp_chan chan, void *value) {
+  if (chan->count == chan->size) {
+    // Grow, keeping the values in order from index 0
+    size_t size = chan->size == 0 ? CHAN_INIT_SIZE : chan->size * 2;
+    void **items = malloc(size * sizeof(*items));
+    assert(items != NULL && "Maybe you should buy more RAM");
+
+    for (size_t i = 0; i < chan->count; i++)
+      items[i] = chan->items[(chan->head + i) & (chan->size - 1)];
+
+    free(chan->items);
+    chan->items = items;
+    chan->size = size;
+    chan->head = 0;
+  }
+
+  chan->items[(chan->head + chan->count) & (chan->size - 1)] = value;
+  chan->count++;
+}
+
+static void *buffer_pop(sp_chan chan) {
+  void *value = chan->items[chan->head];
+  chan->head = (chan->head + 1) & (chan->size - 1);
+  chan->count--;
+  return value;
+}
+
+/* Public Functions */
+
+sp_chan chan_create(sp_stack stack, size_t capacity) {
+  sp_chan chan = malloc(sizeof(*chan));
+  assert(chan != NULL && "Maybe you should buy more RAM");
+
+  chan->stack = stack;
+  chan->capacity = capacity;
+  chan->closed = false;
+  chan->items = NULL;
+  chan->size = 0;
+  chan->head = 0;
+  chan->count = 0;
+  chan->senders = (struct s_chan_queue){NULL, NULL};
+  chan->receivers = (struct s_chan_queue){NULL, NULL};
+  chan->free_waiters = NULL;
+
+  return chan;
+}
+
+void chan_destroy(sp_chan chan) {
+  assert(chan->senders.head == NULL && chan->receivers.head == NULL &&
+         "Cannot destroy a channel with parked contexts");
+
+  while (chan->free_waiters != NULL) {
+    struct s_chan_waiter *waiter = chan->free_waiters;
+    chan->free_waiters = waiter->next;
+    free(waiter);
+  }
+
+  free(chan->items);
+  free(chan);
+}
+
+bool chan_send(sp_chan chan, void *value) {
+  if (chan->closed)
+    return false;
+
+  // Direct handoff: the receiver gets the value and runs right away
+  struct s_chan_waiter *receiver = queue_pop(&chan->receivers);
+  if (receiver != NULL) {
+    receiver->value = value;
+    receiver->ok = true;
+    receiver->done = true;
+    switch_ctx(chan->stack, receiver->ctx);
+    return true;
+  }
+
+  if (chan->count < chan->capacity) {
+    buffer_push(chan, value);
+    return true;
+  }
+
+  struct s_chan_waiter *sender = waiter_get(chan, value);
+  bool ok = waiter_park(chan, &chan->senders, sender);
+  waiter_put(chan, sender);
+  return ok;
+}
+
+bool chan_recv(sp_chan chan, void **value) {
+  struct s_chan_waiter *sender;
+
+  if (chan->count > 0) {
+    *value = buffer_pop(chan);
+
+    // The oldest parked sender takes the freed slot
+    sender = queue_pop(&chan->senders);
+    if (sender != NULL) {
+      buffer_push(chan, sender->value);
+      sender->ok = true;
+      sender->done = true;
+      unpark_ctx(chan->stack, sender->ctx);
+    }
+    return true;
+  }
+
+  // Unbuffered channel: take the value straight from a parked sender
+  sender = queue_pop(&chan->senders);
+  if (sender != NULL) {
+    *value = sender->value;
+    sender->ok = true;
+    sender->done = true;
+    unpark_ctx(chan->stack, sender->ctx);
+    return true;
+  }
+
+  if (chan->closed) {
+    *value = NULL;
+    return false;
+  }
+
+  struct s_chan_waiter *receiver = waiter_get(chan, NULL);
+  bool ok = waiter_park(chan, &chan->receivers, receiver);
+  *value = receiver->value;
+  waiter_put(chan, receiver);
+  return ok;
+}
+
+void chan_close(sp_chan chan) {
+  assert(!chan->closed && "Channel is already closed");
+  chan->closed = true;
+
+  // Parked senders and receivers give up (buffered values stay readable)
+  struct s_chan_queue *queues[] = {&chan->senders, &chan->receivers};
+  for (size_t i = 0; i < 2; i++) {
+    struct s_chan_waiter *waiter;
+    while ((waiter = queue_pop(queues[i])) != NULL) {
+      waiter->value = NULL;
+      waiter->ok = false;
+      waiter->done = true;
+      unpark_ctx(chan->stack, waiter->ctx);
+    }
+  }
+}
+
+/**
+ * @brief Check whether a case can complete without parking
+ */
+static bool is_case_ready(const sp_chan_case *c) {
+  sp_chan chan = c->chan;
+  if (chan->closed)
+    return true;
+  if (c->send)
+    return chan->receivers.head != NULL || chan->count < chan->capacity;
+  return chan->count > 0 || chan->senders.head != NULL;
+}
+
+/**
+ * @brief Complete one case of a select, parking until `deadline` if needed
+ * @param deadline get_time_ns time, 0 to never park, NO_DEADLINE to park
+ * without timer
+ * @return Index of the completed case, or -1
+ */
+static int select_until(sp_chan_case *cases, size_t count, uint64_t deadline) {
+  assert(count > 0 && "Nothing to select on");
+  sp_stack stack = cases[0].chan->stack;
+
+  for (size_t i = 0; i < count; i++) {
+    assert(cases[i].chan->stack == stack &&
+           "Selected channels must share a stack");
+    if (!is_case_ready(&cases[i]))
+      continue;
+
+    if (cases[i].send)
+      cases[i].ok = chan_send(cases[i].chan, cases[i].value);
+    else
+      cases[i].ok = chan_recv(cases[i].chan, &cases[i].value);
+    return (int)i;
+  }
+
+  if (deadline == 0)
+    return -1;
+
+  // Park on every channel at once; the waiters are chained in a ring so the
+  // first one completed dequeues the others
+  struct s_chan_waiter *first = NULL;
+  struct s_chan_waiter *last = NULL;
+  for (size_t i = 0; i < count; i++) {
+    sp_chan chan = cases[i].chan;
+    struct s_chan_waiter *waiter =
+        waiter_get(chan, cases[i].send ? cases[i].value : NULL);
+    queue_push(cases[i].send ? &chan->senders : &chan->receivers, waiter);
+
+    if (first == NULL)
+      first = waiter;
+    else
+      last->sibling = waiter;
+    last = waiter;
+  }
+  last->sibling = first;
+
+  // Spurious unpark_ctx are ignored
+  int selected = -1;
+  bool timed_out = false;
+  while (selected < 0 && !timed_out) {
+    if (deadline == NO_DEADLINE)
+      park_ctx(stack);
+    else
+      timed_out = !park_ctx_until(stack, deadline);
+
+    // A case may still have completed after the timer fired
+    struct s_chan_waiter *waiter = first;
+    for (size_t i = 0; i < count; i++, waiter = waiter->sibling) {
+      if (waiter->done) {
+        selected = (int)i;
+        break;
+      }
+    }
+  }
+
+  // Timed out: every waiter is still queued
+  if (selected < 0) {
+    struct s_chan_waiter *waiter = first;
+    for (size_t i = 0; i < count; i++, waiter = waiter->sibling)
+      queue_remove(waiter->queue, waiter);
+  }
+
+  // Waiters go back to the free list of their own channel
+  struct s_chan_waiter *waiter = first;
+  for (size_t i = 0; i < count; i++) {
+    struct s_chan_waiter *next = waiter->sibling;
+    if ((int)i == selected) {
+      cases[i].ok = waiter->ok;
+      if (!cases[i].send)
+        cases[i].value = waiter->value;
+    }
+    waiter_put(cases[i].chan, waiter);
+    waiter = next;
+  }
+
+  return selected;
+}
+
+int chan_select(sp_chan_case *cases, size_t count, bool block) {
+  return select_until(cases, count, block ? NO_DEADLINE : 0);
+}
+
+int chan_select_until(sp_chan_case *cases, size_t count, uint64_t deadline) {
+  return select_until(cases, count, deadline);
+}
+
+bool is_chan_closed(sp_chan chan) { return chan->closed; }
+
+size_t chan_len(sp_chan chan) { return chan->count; }
@@ -1,8 +1,13 @@
 #include <assert.h>
 #include <limits.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 
 #ifndef MAP_ANONYMOUS
@@ -17,159 +22,1555 @@
 
 struct s_ctx {
   void *rsp;
-  void *stack_base;
+  void *stack_base; // Lowest usable address (just above the guard region)
+  size_t slot;      // Index in active_ctxs (INVALID_CTX_ID if unregistered)
   bool is_done;
+  bool is_queued;   // Linked in the run queue of its stack
+  bool is_parked;   // Left out of scheduling until unpark_ctx
+  bool is_detached; // Destroyed automatically once finished
+  sp_ctx rq_next;   // Run queue links
+  sp_ctx rq_prev;
+  sp_ctx waiters;   // Contexts parked in await_ctx on this one
+  sp_ctx wait_next; // Next waiter on the same context
+  void *result;     // Set by set_ctx_result, read by await_ctx
   size_t stack_size;
+  size_t guard_size; // PROT_NONE bytes mapped below stack_base
+  sp_stack stack; // Owning stack (used to recycle the context on destroy)
+  sp_func fn;     // Entry point (reported on stack overflow)
+  void *arg;      // Argument of fn
+  const char *name;   // Set by create_ctx_ex (reported on stack overflow)
+  bool is_custom;     // Stack geometry of its own: released, never pooled
+  bool is_user_stack; // Stack memory supplied by the caller (never unmapped)
+  bool is_embedded;   // Lives at the top of its stack mapping (see map_ctx)
+
+  // Live part of the stack while switched out (SP_STACK_SHARED only)
+  void *saved;
+  size_t saved_size;
+  size_t saved_capacity;
+
+  // Peak stack usage (SP_STACK_HIGH_WATER only): largest saved_size on a
+  // shared stack, otherwise the usage measured by destroy_ctx or kept by
+  // scavenge_stack before releasing pages
+  size_t high_water;
+
+  // Idle tracking (see scavenge_stack)
+  uint64_t run_epoch;  // Scavenge epoch of the stack when last switched out
+  uint64_t idle_since; // Start of the idle period (0 unknown, SCAVENGED)
+
+  // Timer of park_ctx_until, linked in the timer wheel of its stack
+  uint64_t deadline;   // Expiry tick
+  sp_ctx timer_next;   // Links in the wheel slot
+  sp_ctx timer_prev;
+  size_t timer_slot;   // Index of the slot in s_timer_wheel.slots
+  bool is_timed;       // Linked in the timer wheel
+  bool is_timed_out;   // Woken up by its timer rather than by unpark_ctx
+};
+
+struct s_coroutines {
+  da_struct(sp_ctx);
+};
+
+// Duration of a timer tick, as a power of two of nanoseconds (~1 ms)
+#ifndef TIMER_TICK_SHIFT
+#define TIMER_TICK_SHIFT 20
+#endif // TIMER_TICK_SHIFT
+
+// Levels of the timer wheel: TIMER_LEVELS * TIMER_LEVEL_BITS bits of ticks
+// (~4.9 hours) are covered, later deadlines wait in an overflow list
+#ifndef TIMER_LEVELS
+#define TIMER_LEVELS 4
+#endif // TIMER_LEVELS
+
+#define TIMER_LEVEL_BITS 6
+#define TIMER_SLOTS (1 << TIMER_LEVEL_BITS)
+#define TIMER_OVERFLOW (TIMER_LEVELS * TIMER_SLOTS)
+
+// Clock of timers and get_time_ns
+#ifndef TIMER_CLOCK
+#define TIMER_CLOCK CLOCK_MONOTONIC
+#endif // TIMER_CLOCK
+
+// Hierarchical timing wheel of the contexts parked with a deadline. Slot s
+// of level l holds the timers expiring in the s-th span of 64^l ticks of
+// the current 64^(l+1) span. Expiring timers of level 0 are woken up, and a
+// slot of an upper level is spread over the levels below when `now` enters
+// its span, so insertion and cancellation are O(1) whatever the number of
+// pending timers.
+struct s_timer_wheel {
+  uint64_t now; // Last processed tick
+  size_t count; // Pending timers
+  uint64_t occupied[TIMER_LEVELS]; // Non-empty slots of each level
+  sp_ctx slots[TIMER_OVERFLOW + 1]; // Last one is the overflow list
+};
+
+// Number of power-of-two size classes handled by the stack arena
+#define ARENA_SIZE_CLASSES 32
+
+struct s_arena_chunks {
+  da_struct(char *);
+};
+
+struct s_arena_slots {
+  da_struct(void *);
+};
+
+// Stack arena: slots are carved out of a few large reservations so that many
+// coroutines share a handful of mappings (see SP_STACK_ARENA)
+struct s_arena {
+  struct s_arena_chunks chunks;
+  size_t chunk_used; // Bytes handed out from the last chunk
+  // Free slots of each size class (slot size is page_size << class)
+  struct s_arena_slots free_slots[ARENA_SIZE_CLASSES];
+};
+
+// Shared execution stack: every coroutine of the stack runs on the same
+// memory, and only the owner's frames are in place (see SP_STACK_SHARED)
+struct s_shared {
+  char *base;     // Lowest usable address of the shared stack
+  size_t size;    // Usable size of the shared stack
+  size_t guard;   // PROT_NONE bytes mapped below base
+  sp_ctx owner;   // Context whose frames currently live on the shared stack
+  char *scratch;  // Small stack used while copying frames in and out
+  void *value;    // Value handed to the context resumed through the scratch
+};
+
+struct s_stack {
+  // Dynamic array of coroutine contexts
+  struct s_coroutines active_ctxs;
+  // Pool of destroyed contexts whose stack mapping is kept for reuse
+  struct s_coroutines inactive_ctxs;
+  size_t pool_low;  // Pool size kept after an overflow
+  size_t pool_high; // Pool size that triggers a trim
+  // Finished detached contexts, destroyed once switched off their stack
+  struct s_coroutines deferred;
+
+  // FIFO of runnable contexts (the current context is not queued)
+  sp_ctx rq_head;
+  sp_ctx rq_tail;
+  size_t rq_count;
+
+  // Currently running context
+  sp_ctx current;
+  size_t stack_size;
+  unsigned flags;         // SP_STACK_* flags given to init_stack_ex
+  struct s_arena *arena;  // Stack arena (SP_STACK_ARENA only)
+  sp_stack next_guarded;  // Next stack in the overflow handler registry
+  bool is_guarded;        // Registered with the overflow handler
+  struct s_shared *shared; // Shared execution stack (SP_STACK_SHARED only)
+  size_t high_water; // Peak usage of destroyed contexts (SP_STACK_HIGH_WATER)
+  size_t prefault;   // Bytes faulted in below each new stack top
+  uint64_t scavenge_epoch; // Number of scavenge_stack passes
+  size_t scavenged;        // Bytes released by scavenge_stack
+  struct s_timer_wheel *timers; // Allocated by the first park_ctx_until
+  size_t tick_skip; // Yields left in the current pass (see run_tick)
+  sp_poll_func poller; // Event source (see set_stack_poller)
+  void *poller_arg;
+};
+
+// Pull-based generator running on its own coroutine (see gen_create)
+struct s_gen {
+  sp_stack stack;
+  sp_ctx ctx;      // Generator coroutine (NULL once finished and recycled)
+  sp_ctx consumer; // Context parked in gen_next
+  void *value;     // Value of the last gen_yield (NULL until it comes)
+  bool is_pulling; // A gen_next is in progress
+  sp_gen_func fn;
+  void *arg;
 };
 
-struct s_coroutines {
-  da_struct(sp_ctx);
-};
+// Global contexts stack
+// struct s_stack g_ctx = {};
+
+#define INVALID_CTX_ID (~((size_t)0))
+
+// Default stack pool watermarks (see set_pool_watermarks)
+#ifndef POOL_LOW_WATERMARK
+#define POOL_LOW_WATERMARK 16
+#endif // POOL_LOW_WATERMARK
+
+#ifndef POOL_HIGH_WATERMARK
+#define POOL_HIGH_WATERMARK 64
+#endif // POOL_HIGH_WATERMARK
+
+// Size of a single arena reservation
+#ifndef ARENA_RESERVATION
+#define ARENA_RESERVATION ((size_t)1 << 30) // 1 GiB
+#endif // ARENA_RESERVATION
+
+// Size of the PROT_NONE region mapped below each stack (SP_STACK_GUARD only)
+#ifndef STACK_GUARD_SIZE
+#define STACK_GUARD_SIZE ((size_t)getpagesize())
+#endif // STACK_GUARD_SIZE
+
+// Bytes reserved at the top of a stack mapping for its embedded context,
+// rounded to a cache line so that the stack top stays aligned
+#define CTX_HEADER_SIZE ((sizeof(struct s_ctx) + 63) & ~(size_t)63)
+
+// madvise advice releasing idle stack pages (see scavenge_stack):
+// MADV_DONTNEED drops them at once and reads back zeros, MADV_FREE lets the
+// kernel take them under memory pressure only
+#ifndef SCAVENGE_ADVICE
+#ifdef __APPLE__
+#define SCAVENGE_ADVICE MADV_FREE
+#else
+#define SCAVENGE_ADVICE MADV_DONTNEED
+#endif
+#endif // SCAVENGE_ADVICE
+
+// idle_since of a context whose idle pages are already released
+#define SCAVENGED UINT64_MAX
+
+// Size of the scratch stack used to swap frames of a shared stack
+#define SHARED_SCRATCH_SIZE (64 * 1024)
+
+// Room used to prime the initial frame of a shared stack context
+#define SHARED_PRIME_SIZE 256
+
+// Size of the alternate signal stack used by the overflow handler
+#define SIGNAL_STACK_SIZE (64 * 1024)
+
+// Stacks with guard pages of the calling thread, walked by the overflow
+// handler: a fault is delivered to the thread that caused it, and a stack is
+// only used by its own thread
+static _Thread_local sp_stack g_guarded_stacks = NULL;
+// Alternate signal stack of the calling thread (while it has guarded stacks)
+static _Thread_local void *g_signal_stack = NULL;
+static atomic_flag g_handler_lock = ATOMIC_FLAG_INIT;
+static bool g_has_handler = false;
+static struct sigaction g_prev_segv;
+static struct sigaction g_prev_bus;
+
+// Current coroutine context (NULL for main context)
+// size_t current_ctx_id = INVALID_CTX_ID;
+
+/* Platform Specific Functions */
+
+/**
+ * @brief restore context from rsp
+ * @param rsp The stack pointer to restore from
+ * @param value Value returned by the transfer_ctx call of the context
+ */
+void _asm_restore_ctx(void *, void *);
+
+void *platform_setup_stack(void *, sp_func, sp_stack, void *, sp_ctx);
+
+/* Private Functions */
+
+/**
+ * @brief Get the size class of an arena slot able to hold `size` bytes
+ * @param size The requested stack size
+ * @param slot_size Filled with the size of the slots of the class
+ * @return The size class index
+ */
+static size_t arena_size_class(size_t size, size_t *slot_size) {
+  size_t cls = 0;
+  size_t slot = (size_t)getpagesize();
+
+  while (slot < size) {
+    slot <<= 1;
+    cls++;
+  }
+
+  assert(cls < ARENA_SIZE_CLASSES && slot <= ARENA_RESERVATION &&
+         "Stack size too large for the arena");
+
+  *slot_size = slot;
+  return cls;
+}
+
+static struct s_arena *arena_create(void) {
+  struct s_arena *arena = malloc(sizeof(*arena));
+  da_init(&arena->chunks);
+  arena->chunk_used = ARENA_RESERVATION; // Force a reservation on first use
+
+  for (size_t i = 0; i < ARENA_SIZE_CLASSES; i++)
+    da_init(&arena->free_slots[i]);
+
+  return arena;
+}
+
+static void arena_destroy(struct s_arena *arena) {
+  for (size_t i = 0; i < arena->chunks.count; i++)
+    munmap(arena->chunks.items[i], ARENA_RESERVATION);
+
+  for (size_t i = 0; i < ARENA_SIZE_CLASSES; i++)
+    da_free(&arena->free_slots[i]);
+
+  da_free(&arena->chunks);
+  free(arena);
+}
+
+/**
+ * @brief Allocate a stack slot from the arena
+ * @param arena The arena to allocate from
+ * @param size The requested stack size (rounded up to the slot size)
+ * @return Base address of the slot
+ */
+static void *arena_alloc(struct s_arena *arena, size_t *size) {
+  size_t slot_size;
+  size_t cls = arena_size_class(*size, &slot_size);
+  *size = slot_size;
+
+  struct s_arena_slots *slots = &arena->free_slots[cls];
+  if (slots->count > 0)
+    return slots->items[--slots->count];
+
+  if (arena->chunk_used + slot_size > ARENA_RESERVATION) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+    flags |= MAP_NORESERVE;
+#endif
+
+    char *chunk = mmap(NULL, ARENA_RESERVATION, PROT_READ | PROT_WRITE, flags,
+                       -1, 0);
+    assert(chunk != MAP_FAILED && "Failed to reserve stack arena");
+
+    da_append(&arena->chunks, chunk);
+    arena->chunk_used = 0;
+  }
+
+  // Bump-allocate a fresh slot from the last reservation
+  char *chunk = arena->chunks.items[arena->chunks.count - 1];
+  void *slot = chunk + arena->chunk_used;
+  arena->chunk_used += slot_size;
+
+  return slot;
+}
+
+/**
+ * @brief Return a stack slot to the arena and drop its physical pages
+ * @param arena The arena owning the slot
+ * @param base Base address of the slot
+ * @param size Size of the slot (as returned by arena_alloc)
+ */
+static void arena_free(struct s_arena *arena, void *base, size_t size) {
+  size_t slot_size;
+  size_t cls = arena_size_class(size, &slot_size);
+
+#ifdef MADV_DONTNEED
+  madvise(base, slot_size, MADV_DONTNEED);
+#endif
+
+  da_append(&arena->free_slots[cls], base);
+}
+
+/**
+ * @brief Write a string to stderr (async-signal-safe)
+ */
+static bool write_str(const char *str) {
+  size_t len = 0;
+
+  while (str[len] != '\0')
+    len++;
+  return write(STDERR_FILENO, str, len) >= 0;
+}
+
+/**
+ * @brief Write a pointer in hexadecimal (async-signal-safe)
+ * @param label Text written before the value
+ * @param value The value to write
+ */
+static void write_hex(const char *label, uintptr_t value) {
+  char buf[2 + 2 * sizeof(value)];
+
+  if (!write_str(label))
+    return;
+
+  buf[0] = '0';
+  buf[1] = 'x';
+  for (size_t i = 0; i < 2 * sizeof(value); i++) {
+    unsigned nibble = (value >> (4 * (2 * sizeof(value) - 1 - i))) & 0xf;
+    buf[2 + i] = "0123456789abcdef"[nibble];
+  }
+  if (write(STDERR_FILENO, buf, sizeof(buf)) < 0)
+    return;
+}
+
+/**
+ * @brief Find the context whose guard region contains `addr`
+ *
+ * Only walks the stacks of the faulting thread, which is stopped in the
+ * handler, so nothing changes under it. Best effort if the fault hits while
+ * that thread is updating its own lists (e.g. an overflow inside
+ * create_ctx): the report may then miss the context.
+ *
+ * @param addr The faulting address
+ * @return The overflowing context, or NULL if `addr` is not in a guard
+ */
+static sp_ctx find_overflowed_ctx(uintptr_t addr) {
+  for (sp_stack stack = g_guarded_stacks; stack != NULL;
+       stack = stack->next_guarded) {
+    if (stack->shared != NULL) {
+      // Only the owner runs on (and can overflow) the shared stack
+      uintptr_t base = (uintptr_t)stack->shared->base;
+      if (addr < base && addr >= base - stack->shared->guard)
+        return stack->shared->owner;
+      continue;
+    }
+
+    // Context 0 is the main context and has no guard
+    for (size_t i = 1; i < stack->active_ctxs.count; i++) {
+      sp_ctx ctx = stack->active_ctxs.items[i];
+      uintptr_t base = (uintptr_t)ctx->stack_base;
+
+      if (addr < base && addr >= base - ctx->guard_size)
+        return ctx;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief SIGSEGV/SIGBUS handler reporting coroutine stack overflows
+ *
+ * Runs on the alternate signal stack. Faults outside of a guard region are
+ * forwarded to the previously installed handler.
+ */
+static void overflow_handler(int sig, siginfo_t *info, void *uctx) {
+  struct sigaction *prev = sig == SIGSEGV ? &g_prev_segv : &g_prev_bus;
+  sp_ctx ctx = find_overflowed_ctx((uintptr_t)info->si_addr);
+
+  if (ctx != NULL) {
+    write_hex("coroutine: stack overflow in ctx ", (uintptr_t)ctx);
+    if (ctx->name != NULL) {
+      write_str(" \"");
+      write_str(ctx->name);
+      write_str("\"");
+    }
+    write_hex(" (fn ", (uintptr_t)ctx->fn);
+    write_hex(") at ", (uintptr_t)info->si_addr);
+    if (write(STDERR_FILENO, "\n", 1) < 0) {
+      // Nothing left to do, the default action follows
+    }
+  } else if (prev->sa_flags & SA_SIGINFO) {
+    prev->sa_sigaction(sig, info, uctx);
+    return;
+  } else if (prev->sa_handler != SIG_DFL && prev->sa_handler != SIG_IGN) {
+    prev->sa_handler(sig);
+    return;
+  }
+
+  // Returning re-executes the faulting access with the default action
+  signal(sig, SIG_DFL);
+}
+
+/**
+ * @brief Register a stack with the overflow handler
+ *
+ * Installs the SIGSEGV/SIGBUS handler on first use and an alternate signal
+ * stack on the calling thread, so that the handler can run once a coroutine
+ * has exhausted its own stack.
+ */
+static void register_guarded_stack(sp_stack stack) {
+  while (atomic_flag_test_and_set(&g_handler_lock))
+    ;
+
+  if (!g_has_handler) {
+    struct sigaction sa = {0};
+    sa.sa_sigaction = overflow_handler;
+    sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&sa.sa_mask);
+
+    sigaction(SIGSEGV, &sa, &g_prev_segv);
+    sigaction(SIGBUS, &sa, &g_prev_bus);
+    g_has_handler = true;
+  }
+
+  atomic_flag_clear(&g_handler_lock);
+
+  if (g_signal_stack == NULL) {
+    stack_t ss = {0};
+    ss.ss_sp = malloc(SIGNAL_STACK_SIZE);
+    ss.ss_size = SIGNAL_STACK_SIZE;
+    assert(ss.ss_sp != NULL && sigaltstack(&ss, NULL) == 0 &&
+           "Failed to install the alternate signal stack");
+    g_signal_stack = ss.ss_sp;
+  }
+
+  // The handler may run at any point on this thread: link before publishing
+  stack->next_guarded = g_guarded_stacks;
+  atomic_signal_fence(memory_order_seq_cst);
+  g_guarded_stacks = stack;
+  stack->is_guarded = true;
+}
+
+/**
+ * @brief Remove a stack from the overflow handler
+ *
+ * The alternate signal stack goes away with the last guarded stack of the
+ * thread.
+ */
+static void unregister_guarded_stack(sp_stack stack) {
+  sp_stack *it = &g_guarded_stacks;
+  while (*it != NULL && *it != stack)
+    it = &(*it)->next_guarded;
+  assert(*it == stack &&
+         "Guarded stacks must be deinitialized on the thread using them");
+  *it = stack->next_guarded;
+  stack->is_guarded = false;
+
+  if (g_guarded_stacks == NULL) {
+    stack_t ss = {0};
+    ss.ss_flags = SS_DISABLE;
+    sigaltstack(&ss, NULL);
+    free(g_signal_stack);
+    g_signal_stack = NULL;
+  }
+}
+
+/**
+ * @brief Map memory for a stack
+ *
+ * The whole stack is mapped up front (pages are only faulted in when used).
+ * MAP_GROWSDOWN is not used: it brings nothing to a fixed-size stack, and the
+ * kernel gap search around many growsdown mappings makes mmap about a hundred
+ * times slower once thousands of them exist.
+ *
+ * @param size Size of the mapping
+ * @return Base of the mapping
+ */
+static char *map_stack(size_t size) {
+  int prot = PROT_WRITE | PROT_READ;
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_STACK
+  flags |= MAP_STACK;
+#endif
+
+  char *base = mmap(NULL, size, prot, flags, -1, 0);
+  assert(base != MAP_FAILED && "Failed to allocate stack for coroutine");
+
+  return base;
+}
+
+static struct s_shared *shared_create(size_t size, size_t guard) {
+  size_t page = (size_t)getpagesize();
+  struct s_shared *shared = malloc(sizeof(*shared));
+
+  // Keep the top page-aligned so that frames primed elsewhere stay aligned
+  shared->size = (size + page - 1) & ~(page - 1);
+  shared->guard = guard;
+  shared->base = map_stack(shared->size + guard) + guard;
+  shared->owner = NULL;
+  shared->value = NULL;
+  shared->scratch = map_stack(SHARED_SCRATCH_SIZE);
+
+  if (guard > 0) {
+    int ret = mprotect(shared->base - guard, guard, PROT_NONE);
+    assert(ret == 0 && "Failed to protect the stack guard region");
+    (void)ret;
+  }
+
+  return shared;
+}
+
+static void shared_destroy(struct s_shared *shared) {
+  munmap(shared->base - shared->guard, shared->size + shared->guard);
+  munmap(shared->scratch, SHARED_SCRATCH_SIZE);
+  free(shared);
+}
+
+/**
+ * @brief Store frames into the save buffer of a shared stack context
+ * @param ctx The context owning the frames
+ * @param frames Start of the frames (lowest address)
+ * @param size Size of the frames in bytes
+ */
+static void shared_store(sp_ctx ctx, const void *frames, size_t size) {
+  if (size > ctx->saved_capacity) {
+    ctx->saved = realloc(ctx->saved, size);
+    assert(ctx->saved != NULL && "Maybe you should buy more RAM");
+    ctx->saved_capacity = size;
+  }
+
+  memcpy(ctx->saved, frames, size);
+  ctx->saved_size = size;
+
+  if (size > ctx->high_water)
+    ctx->high_water = size;
+}
+
+/**
+ * @brief Measure how much of a stack has been used
+ *
+ * Stack memory starts zero-filled, so the lowest non-zero word marks the
+ * deepest point reached. Pages that were never touched are skipped with
+ * mincore instead of being read (and faulted in).
+ *
+ * @param base Lowest address of the stack (page-aligned)
+ * @param size Size of the stack
+ * @return Bytes between the deepest written word and the top of the stack
+ */
+static size_t scan_high_water(const char *base, size_t size) {
+  size_t page = (size_t)getpagesize();
+  size_t pages = size / page;
+#ifdef __APPLE__
+  char resident[64];
+#else
+  unsigned char resident[64];
+#endif
+
+  for (size_t first = 0; first < pages; first += sizeof(resident)) {
+    size_t count = pages - first;
+    if (count > sizeof(resident))
+      count = sizeof(resident);
+
+    bool known = mincore((void *)(base + first * page), count * page,
+                         resident) == 0;
+
+    for (size_t i = 0; i < count; i++) {
+      if (known && !(resident[i] & 1))
+        continue; // Never touched
+
+      const uint64_t *word = (const uint64_t *)(base + (first + i) * page);
+      const uint64_t *end = word + page / sizeof(*word);
+      for (; word < end; word++) {
+        if (*word != 0)
+          return (size_t)(base + size - (const char *)word);
+      }
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Fault in the top of a stack ahead of its first run
+ * @param base Lowest usable address of the stack
+ * @param size Usable size of the stack
+ * @param bytes Depth to fault in, clamped to the stack size
+ */
+static void prefault_stack(char *base, size_t size, size_t bytes) {
+  size_t page = (size_t)getpagesize();
+  char *top = base + size;
+
+  if (bytes > size)
+    bytes = size;
+
+#ifdef MADV_POPULATE_WRITE
+  // A single call maps the whole range writable without touching it
+  // (Linux 5.14+). The range is widened to pages, which stay inside the
+  // mapping as stack tops are page aligned or embed a context.
+  uintptr_t low = ((uintptr_t)(top - bytes) & ~(uintptr_t)(page - 1));
+  uintptr_t high = ((uintptr_t)top + page - 1) & ~(uintptr_t)(page - 1);
+  if (low >= (uintptr_t)base &&
+      madvise((void *)low, high - low, MADV_POPULATE_WRITE) == 0)
+    return;
+#endif
+
+  // Stacks grow down: touch one byte per page starting from the top. Zero is
+  // written so that high-water scanning does not count the touched pages.
+  volatile char *end = top;
+  for (size_t depth = 1; depth <= bytes; depth += page)
+    end[-(ptrdiff_t)depth] = 0;
+}
+
+/**
+ * @brief Initialize the allocation fields of a new context
+ * @param ctx The context memory
+ * @param stack The stack the context belongs to
+ */
+static void init_ctx(sp_ctx ctx, sp_stack stack) {
+  ctx->stack = stack;
+  ctx->saved = NULL;
+  ctx->saved_size = 0;
+  ctx->saved_capacity = 0;
+  ctx->high_water = 0;
+  ctx->is_custom = false;
+  ctx->is_user_stack = false;
+  ctx->is_embedded = false;
+}
+
+/**
+ * @brief Allocate a context on the heap, without stack
+ * @param stack The stack the context belongs to
+ */
+static sp_ctx new_ctx(sp_stack stack) {
+  sp_ctx ctx = malloc(sizeof(*ctx));
+  init_ctx(ctx, stack);
+
+  return ctx;
+}
+
+/**
+ * @brief Map stack memory, from the arena if the stack has one
+ * @param stack The stack the memory is for (not a shared stack)
+ * @param size Bytes to map including the guard region, updated to the size
+ * actually mapped
+ * @param guard PROT_NONE bytes to protect at the bottom of the mapping
+ * @return Base of the mapping (start of the guard region)
+ */
+static char *map_ctx_region(sp_stack stack, size_t *size, size_t guard) {
+  char *base;
+
+  if (stack->arena != NULL) {
+    base = arena_alloc(stack->arena, size);
+  } else {
+    base = map_stack(*size);
+  }
+
+  if (guard > 0) {
+    int ret = mprotect(base, guard, PROT_NONE);
+    assert(ret == 0 && "Failed to protect the stack guard region");
+    (void)ret;
+  }
+
+  return base;
+}
+
+/**
+ * @brief Map the stack of a context (and its guard region)
+ * @param stack The stack the context belongs to (not a shared stack)
+ * @param ctx The context to map: stack_size and guard_size hold the requested
+ * geometry, and are updated along with stack_base to what was mapped
+ */
+static void map_ctx_stack(sp_stack stack, sp_ctx ctx) {
+  size_t size = ctx->stack_size + ctx->guard_size;
+  char *base = map_ctx_region(stack, &size, ctx->guard_size);
+
+  ctx->stack_base = base + ctx->guard_size;
+  ctx->stack_size = size - ctx->guard_size;
+
+  if (stack->prefault > 0)
+    prefault_stack(ctx->stack_base, ctx->stack_size, stack->prefault);
+}
+
+/**
+ * @brief Map a stack with its context embedded at the top of the mapping
+ *
+ * Spawning is then a single allocation, and the context shares its page (and
+ * often its cache lines) with the outermost frames of the coroutine. The
+ * header is taken from the requested size.
+ *
+ * @param stack The stack the context belongs to (not a shared stack)
+ * @param size Size of the mapping without its guard region
+ * @param guard PROT_NONE bytes to map below the stack
+ * @return The context, with its stack_base, stack_size and guard_size set
+ */
+static sp_ctx map_ctx(sp_stack stack, size_t size, size_t guard) {
+  assert(size > CTX_HEADER_SIZE && "Stack too small for its context");
+
+  size_t total = size + guard;
+  char *base = map_ctx_region(stack, &total, guard);
+
+  sp_ctx ctx = (sp_ctx)(base + total - CTX_HEADER_SIZE);
+  init_ctx(ctx, stack);
+  ctx->is_embedded = true;
+  ctx->stack_base = base + guard;
+  ctx->stack_size = total - guard - CTX_HEADER_SIZE;
+  ctx->guard_size = guard;
+
+  if (stack->prefault > 0)
+    prefault_stack(ctx->stack_base, ctx->stack_size, stack->prefault);
+
+  return ctx;
+}
+
+/**
+ * @brief Get a context with a mapped stack, reusing a pooled one if possible
+ * @param stack The stack the context belongs to
+ * @param lazy Leave a new context without stack (see SP_STACK_LAZY)
+ * @return A context whose stack is ready to be set up (stack_base is NULL if
+ * the stack is left to map_ctx_stack)
+ */
+static sp_ctx alloc_ctx(sp_stack stack, bool lazy) {
+  if (stack->inactive_ctxs.count > 0) {
+    // Reuse the most recently destroyed context (its stack is still warm)
+    sp_ctx ctx = stack->inactive_ctxs.items[--stack->inactive_ctxs.count];
+
+    // Clear what the previous coroutine used so it is not measured again
+    if ((stack->flags & SP_STACK_HIGH_WATER) && stack->shared == NULL) {
+      char *top = (char *)ctx->stack_base + ctx->stack_size;
+      memset(top - ctx->high_water, 0, ctx->high_water);
+      ctx->high_water = 0;
+    }
+
+    return ctx;
+  }
+
+  size_t guard = (stack->flags & SP_STACK_GUARD) ? STACK_GUARD_SIZE : 0;
+  if (stack->shared == NULL && !lazy)
+    return map_ctx(stack, stack->stack_size, guard);
+
+  sp_ctx ctx = new_ctx(stack);
+
+  if (stack->shared != NULL) {
+    ctx->stack_base = stack->shared->base;
+    ctx->stack_size = stack->shared->size;
+    ctx->guard_size = stack->shared->guard;
+  } else {
+    ctx->stack_base = NULL;
+    ctx->stack_size = stack->stack_size;
+    ctx->guard_size = guard;
+  }
+
+  return ctx;
+}
+
+/**
+ * @brief Build the initial frame of a context so that resuming it calls
+ * `ctx->fn(stack, ctx->arg)`
+ */
+static void prime_ctx(sp_stack stack, sp_ctx ctx) {
+  char *top = (char *)ctx->stack_base + ctx->stack_size;
+
+  if (stack->shared != NULL) {
+    // The shared stack may be in use: prime the initial frame aside, it is
+    // copied in place on first resume (frames are position independent)
+    _Alignas(16) char frame[SHARED_PRIME_SIZE];
+    char *frame_top = frame + sizeof(frame);
+    char *rsp = platform_setup_stack(frame_top, ctx->fn, stack, ctx->arg, ctx);
+
+    shared_store(ctx, rsp, (size_t)(frame_top - rsp));
+    ctx->rsp = top - (frame_top - rsp);
+  } else {
+    ctx->rsp = platform_setup_stack(top, ctx->fn, stack, ctx->arg, ctx);
+  }
+}
+
+static void release_ctx(sp_ctx ctx) {
+  if (ctx->stack->shared != NULL) {
+    // The shared stack itself is released by deinit_stack
+    free(ctx->saved);
+    free(ctx);
+    return;
+  }
+
+  struct s_arena *arena = ctx->stack->arena;
+  char *base = (char *)ctx->stack_base - ctx->guard_size;
+  size_t size = ctx->stack_size + ctx->guard_size;
+  size_t guard = ctx->guard_size;
+  bool is_user_stack = ctx->is_user_stack;
+
+  // An embedded context goes away with its mapping
+  if (ctx->is_embedded)
+    size += CTX_HEADER_SIZE;
+  else
+    free(ctx);
+
+  if (is_user_stack) {
+    // The caller of create_ctx_ex owns the memory
+  } else if (arena != NULL) {
+    // Slots are handed out again without a guard unless re-protected
+    if (guard > 0)
+      mprotect(base, guard, PROT_READ | PROT_WRITE);
+    arena_free(arena, base, size);
+  } else {
+    munmap(base, size);
+  }
+}
+
+/**
+ * @brief Move the frames of `arg` onto the shared stack and resume it
+ *
+ * Runs on the scratch stack: the frames of the previous owner are copied out
+ * (only its live part, from its saved rsp to the top) before the frames of
+ * the target are copied in.
+ */
+__attribute__((noreturn)) static void shared_swap(sp_stack stack, void *arg) {
+  sp_ctx ctx = arg;
+  struct s_shared *shared = stack->shared;
+  sp_ctx owner = shared->owner;
+
+  if (owner != NULL) {
+    shared_store(owner, owner->rsp,
+                 (size_t)(shared->base + shared->size - (char *)owner->rsp));
+  }
+
+  memcpy(ctx->rsp, ctx->saved, ctx->saved_size);
+  shared->owner = ctx;
+
+  _asm_restore_ctx(ctx->rsp, shared->value);
+  abort(); // Unreachable
+}
+
+/**
+ * @brief Get the stack pointer to restore to resume the given context
+ *
+ * Contexts of a shared stack whose frames are not in place are resumed
+ * through shared_swap on the scratch stack, as the frames cannot be copied
+ * over the stack we are running on. `value` is then carried by the shared
+ * stack instead of a register. Lazy contexts get their stack on first resume.
+ */
+static void *resume_rsp(sp_stack stack, sp_ctx ctx, void *value) {
+  struct s_shared *shared = stack->shared;
+
+  if (ctx->rsp == NULL) {
+    map_ctx_stack(stack, ctx);
+    prime_ctx(stack, ctx);
+  }
+
+  if (shared != NULL && ctx->stack_base != NULL && ctx != shared->owner) {
+    shared->value = value;
+    return platform_setup_stack(shared->scratch + SHARED_SCRATCH_SIZE,
+                                shared_swap, stack, ctx, NULL);
+  }
+
+  return ctx->rsp;
+}
+
+/**
+ * @brief Restore the given context
+ */
+__attribute__((noreturn)) static void resume_ctx(sp_stack stack, sp_ctx ctx) {
+  _asm_restore_ctx(resume_rsp(stack, ctx, NULL), NULL);
+  abort(); // Unreachable
+}
+
+/**
+ * @brief Register a context in the active contexts of a stack
+ */
+static void add_active_ctx(sp_stack stack, sp_ctx ctx) {
+  ctx->slot = stack->active_ctxs.count;
+  da_append(&stack->active_ctxs, ctx);
+}
+
+/**
+ * @brief Remove the context at `idx` from the active contexts of a stack
+ *
+ * The last context is moved into the freed slot, so its slot index is
+ * updated to keep lookups constant-time.
+ */
+static void remove_active_ctx(sp_stack stack, size_t idx) {
+  stack->active_ctxs.items[idx]->slot = INVALID_CTX_ID;
+  da_fast_remove(&stack->active_ctxs, idx);
+
+  if (idx < stack->active_ctxs.count)
+    stack->active_ctxs.items[idx]->slot = idx;
+}
+
+static void rq_push_back(sp_stack stack, sp_ctx ctx) {
+  ctx->rq_next = NULL;
+  ctx->rq_prev = stack->rq_tail;
+
+  if (stack->rq_tail != NULL)
+    stack->rq_tail->rq_next = ctx;
+  else
+    stack->rq_head = ctx;
+
+  stack->rq_tail = ctx;
+  stack->rq_count++;
+  ctx->is_queued = true;
+}
+
+static void rq_push_front(sp_stack stack, sp_ctx ctx) {
+  ctx->rq_prev = NULL;
+  ctx->rq_next = stack->rq_head;
+
+  if (stack->rq_head != NULL)
+    stack->rq_head->rq_prev = ctx;
+  else
+    stack->rq_tail = ctx;
+
+  stack->rq_head = ctx;
+  stack->rq_count++;
+  ctx->is_queued = true;
+}
+
+static void rq_remove(sp_stack stack, sp_ctx ctx) {
+  if (ctx->rq_prev != NULL)
+    ctx->rq_prev->rq_next = ctx->rq_next;
+  else
+    stack->rq_head = ctx->rq_next;
+
+  if (ctx->rq_next != NULL)
+    ctx->rq_next->rq_prev = ctx->rq_prev;
+  else
+    stack->rq_tail = ctx->rq_prev;
+
+  stack->rq_count--;
+  ctx->is_queued = false;
+}
+
+/**
+ * @brief Pop the next runnable context
+ * @return The head of the run queue, or NULL if it is empty
+ */
+static sp_ctx rq_pop(sp_stack stack) {
+  sp_ctx ctx = stack->rq_head;
+  if (ctx != NULL)
+    rq_remove(stack, ctx);
+  return ctx;
+}
+
+static uint64_t clock_ns(void) {
+  struct timespec ts;
+  clock_gettime(TIMER_CLOCK, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void timer_link(struct s_timer_wheel *wheel, sp_ctx ctx) {
+  // The lowest level whose current span holds the deadline
+  size_t index = TIMER_OVERFLOW;
+  for (size_t level = 0; level < TIMER_LEVELS; level++) {
+    unsigned span = (level + 1) * TIMER_LEVEL_BITS;
+    if ((ctx->deadline >> span) == (wheel->now >> span)) {
+      size_t slot = (ctx->deadline >> (level * TIMER_LEVEL_BITS)) &
+                    (TIMER_SLOTS - 1);
+      wheel->occupied[level] |= 1ull << slot;
+      index = level * TIMER_SLOTS + slot;
+      break;
+    }
+  }
+
+  ctx->timer_slot = index;
+  ctx->timer_prev = NULL;
+  ctx->timer_next = wheel->slots[index];
+  if (ctx->timer_next != NULL)
+    ctx->timer_next->timer_prev = ctx;
+  wheel->slots[index] = ctx;
+}
+
+static void timer_unlink(struct s_timer_wheel *wheel, sp_ctx ctx) {
+  if (ctx->timer_prev != NULL)
+    ctx->timer_prev->timer_next = ctx->timer_next;
+  else
+    wheel->slots[ctx->timer_slot] = ctx->timer_next;
+
+  if (ctx->timer_next != NULL)
+    ctx->timer_next->timer_prev = ctx->timer_prev;
+
+  if (wheel->slots[ctx->timer_slot] == NULL &&
+      ctx->timer_slot != TIMER_OVERFLOW) {
+    wheel->occupied[ctx->timer_slot / TIMER_SLOTS] &=
+        ~(1ull << (ctx->timer_slot % TIMER_SLOTS));
+  }
+
+  ctx->is_timed = false;
+  wheel->count--;
+}
+
+/**
+ * @brief Find the next tick at which a slot expires or is spread out
+ * @warning The wheel must have pending timers
+ */
+static uint64_t timer_next_tick(const struct s_timer_wheel *wheel) {
+  // Slots after the current one at the lowest level that has some
+  for (size_t level = 0; level < TIMER_LEVELS; level++) {
+    unsigned shift = level * TIMER_LEVEL_BITS;
+    unsigned current = (wheel->now >> shift) & (TIMER_SLOTS - 1);
+    uint64_t later = current + 1 < TIMER_SLOTS
+                         ? wheel->occupied[level] & (~0ull << (current + 1))
+                         : 0;
+
+    if (later != 0) {
+      uint64_t span = shift + TIMER_LEVEL_BITS;
+      return (wheel->now >> span << span) |
+             ((uint64_t)__builtin_ctzll(later) << shift);
+    }
+  }
+
+  // Only overflowed timers: they are sorted again when the top level wraps
+  unsigned span = TIMER_LEVELS * TIMER_LEVEL_BITS;
+  return ((wheel->now >> span) + 1) << span;
+}
+
+/**
+ * @brief Process the ticks up to `tick`, making expired contexts runnable
+ */
+static void timer_advance(sp_stack stack, uint64_t tick) {
+  struct s_timer_wheel *wheel = stack->timers;
+
+  // Jump from one non-empty slot to the next instead of walking every tick
+  while (wheel->count > 0) {
+    uint64_t next = timer_next_tick(wheel);
+    if (next > tick)
+      break;
+    wheel->now = next;
+
+    // Spread the slots whose span starts now over the levels below, from
+    // the top so that their timers can fall through several levels
+    for (size_t level = TIMER_LEVELS; level > 0; level--) {
+      unsigned shift = level * TIMER_LEVEL_BITS;
+      if ((next & ((1ull << shift) - 1)) != 0)
+        continue;
 
-struct s_stack {
-  // Dynamic array of coroutine contexts
-  struct s_coroutines active_ctxs;
-  struct s_coroutines inactive_ctxs;
+      size_t index = level == TIMER_LEVELS
+                         ? TIMER_OVERFLOW
+                         : level * TIMER_SLOTS +
+                               ((next >> shift) & (TIMER_SLOTS - 1));
+      sp_ctx ctx = wheel->slots[index];
+      wheel->slots[index] = NULL;
+      if (level < TIMER_LEVELS)
+        wheel->occupied[level] &= ~(1ull << (index % TIMER_SLOTS));
 
-  // Current context index
-  size_t current_index;
-  size_t stack_size;
-};
+      while (ctx != NULL) {
+        sp_ctx next_ctx = ctx->timer_next;
+        timer_link(wheel, ctx);
+        ctx = next_ctx;
+      }
+    }
 
-// Global contexts stack
-// struct s_stack g_ctx = {};
+    // Expire the current slot of level 0
+    size_t slot = next & (TIMER_SLOTS - 1);
+    sp_ctx ctx = wheel->slots[slot];
+    wheel->slots[slot] = NULL;
+    wheel->occupied[0] &= ~(1ull << slot);
 
-#define INVALID_CTX_ID (~((size_t)0))
+    while (ctx != NULL) {
+      sp_ctx next_ctx = ctx->timer_next;
+      ctx->is_timed = false;
+      wheel->count--;
 
-// Current coroutine context (NULL for main context)
-// size_t current_ctx_id = INVALID_CTX_ID;
+      // Already woken up by unpark_ctx otherwise
+      if (ctx->is_parked) {
+        ctx->is_timed_out = true;
+        ctx->is_parked = false;
+        rq_push_back(stack, ctx);
+      }
+      ctx = next_ctx;
+    }
+  }
 
-/* Platform Specific Functions */
+  if (tick > wheel->now)
+    wheel->now = tick;
+}
+
+static inline bool has_timers(sp_stack stack) {
+  return stack->timers != NULL && stack->timers->count > 0;
+}
 
 /**
- * @brief restore context from rsp
- * @param rsp The stack pointer to restore from
+ * @brief Scheduler tick: advance the timers to the current time and poll
+ * the event source, once every context queued at the previous tick has run
+ *
+ * A context made runnable is queued at the tail anyway, so this delays it by
+ * one pass over the run queue at most, and amortizes the clock read and the
+ * poll over every yield of the pass.
  */
-void _asm_restore_ctx(void *);
+static inline void run_tick(sp_stack stack) {
+  bool timed = has_timers(stack);
+  if ((!timed && stack->poller == NULL) || stack->tick_skip-- > 0)
+    return;
+
+  stack->tick_skip = stack->rq_count;
+  if (timed)
+    timer_advance(stack, clock_ns() >> TIMER_TICK_SHIFT);
+  if (stack->poller != NULL)
+    stack->poller(stack, stack->poller_arg, 0);
+}
+
+/**
+ * @brief Wait for a timer or an event to make a context runnable
+ * @return The next runnable context, or NULL if nothing can wake one up
+ */
+static sp_ctx wait_events(sp_stack stack) {
+  for (;;) {
+    bool timed = has_timers(stack);
+    uint64_t timeout = SP_POLL_FOREVER;
+    if (timed) {
+      uint64_t at = timer_next_tick(stack->timers) << TIMER_TICK_SHIFT;
+      uint64_t now = clock_ns();
+      timeout = at > now ? at - now : 0;
+    }
+
+    // The poller blocks until an event or the next timer, if it has
+    // anything pending
+    bool polled = stack->poller != NULL &&
+                  stack->poller(stack, stack->poller_arg, timeout);
+    // Nothing left to wait for on the poller side (its last events may
+    // still have woken contexts up): sleep until the next timer
+    if (!polled && stack->rq_count == 0) {
+      if (!timed)
+        return NULL;
+      if (timeout > 0) {
+        struct timespec pause = {(time_t)(timeout / 1000000000ull),
+                                 (long)(timeout % 1000000000ull)};
+        nanosleep(&pause, NULL);
+      }
+    }
+
+    if (timed)
+      timer_advance(stack, clock_ns() >> TIMER_TICK_SHIFT);
+    sp_ctx ctx = rq_pop(stack);
+    if (ctx != NULL)
+      return ctx;
+  }
+}
 
 /**
- * @brief Switch to the given coroutine context
- * @param ctx The coroutine context to switch to
+ * @brief Destroy the finished detached contexts of a stack
+ *
+ * Called on scheduler entry, when no deferred context can be running.
  */
-void switch_ctx(sp_stack, sp_ctx);
+static void drain_deferred(sp_stack stack) {
+  while (stack->deferred.count > 0)
+    destroy_ctx(stack->deferred.items[--stack->deferred.count]);
+}
 
 /**
- * @brief Yield to the previous coroutine context
+ * @brief Called when a coroutine function returns
+ * @param current_ctx The finished context (its stack may differ from the one
+ * it was created on, see register_ctx)
  */
-void yield_ctx(sp_stack);
+void coroutine_finish(sp_ctx current_ctx) {
+  sp_stack stack = current_ctx->stack;
+  assert(current_ctx == stack->current && current_ctx->slot != 0 &&
+         "Main context cannot finish");
 
-void *platform_setup_stack(void *, sp_func, sp_stack, void *);
+  current_ctx->is_done = true; // mark as done
 
-/* Private Functions */
+  // We are still running on its stack: destroyed at the next scheduler entry
+  if (current_ctx->is_detached)
+    da_append(&stack->deferred, current_ctx);
 
-void coroutine_finish(sp_stack stack) {
-  size_t current_ctx_id = stack->current_index;
-  assert(current_ctx_id != 0 && "Main context cannot finish");
+  // Frames of a finished context are never copied out
+  if (stack->shared != NULL && stack->shared->owner == current_ctx)
+    stack->shared->owner = NULL;
 
-  sp_ctx current_ctx = stack->active_ctxs.items[current_ctx_id];
-  current_ctx->is_done = true; // mark as done
+  remove_active_ctx(stack, current_ctx->slot);
 
-  da_fast_remove(&stack->active_ctxs, current_ctx_id);
+  // Wake up the contexts awaiting this one: the most recent one is resumed
+  // right away, the others are queued
+  sp_ctx ctx = NULL;
+  for (sp_ctx waiter = current_ctx->waiters; waiter != NULL;
+       waiter = waiter->wait_next) {
+    if (!waiter->is_parked)
+      continue; // Already woken up by unpark_ctx
 
-  sp_ctx ctx = stack->active_ctxs.items[--stack->current_index];
-  _asm_restore_ctx(ctx->rsp);
+    waiter->is_parked = false;
+    if (ctx == NULL)
+      ctx = waiter;
+    else
+      rq_push_back(stack, waiter);
+  }
+  current_ctx->waiters = NULL;
+
+  if (ctx == NULL)
+    ctx = rq_pop(stack);
+  if (ctx == NULL)
+    ctx = wait_events(stack);
+  assert(ctx != NULL && "No runnable context left");
+  stack->current = ctx;
+  resume_ctx(stack, ctx);
 
   // Unreachable code here
   assert(false && "coroutine_finish: Unreachable code reached");
   abort();
 }
 
-size_t get_ctx_id(sp_stack stack) { return stack->current_index; }
-
 size_t get_ctx_id_of(sp_stack stack, sp_ctx ctx) {
   if (ctx == NULL)
     return 0; // Main context
 
-  for (size_t i = 0; i < stack->active_ctxs.count; i++) {
-    if (stack->active_ctxs.items[i] == ctx) {
-      return i;
-    }
-  }
+  (void)stack;
+  return ctx->slot;
+}
 
-  return INVALID_CTX_ID;
+/**
+ * @brief Build the switch from the current context to `ctx`
+ * @return The save slot of the current context and the stack pointer to
+ * resume (no save slot if `ctx` is already running)
+ */
+static struct sp_switch switch_to(sp_stack stack, sp_ctx ctx, void *value) {
+  sp_ctx current_ctx = stack->current;
+  if (ctx == current_ctx)
+    return (struct sp_switch){NULL, NULL};
+
+  stack->current = ctx;
+  current_ctx->run_epoch = stack->scavenge_epoch;
+  return (struct sp_switch){&current_ctx->rsp, resume_rsp(stack, ctx, value)};
 }
 
-__attribute__((noreturn)) void switch_ctx_inner(sp_stack stack, sp_ctx ctx,
-                                                void *rsp) {
+struct sp_switch _prepare_switch_ctx(sp_stack stack, sp_ctx ctx,
+                                     void *value) {
+  if (stack->deferred.count > 0)
+    drain_deferred(stack);
+
   if (ctx == NULL) {
     ctx = stack->active_ctxs.items[0]; // Main context
   }
 
-  sp_ctx current_ctx = stack->active_ctxs.items[stack->current_index];
-  // Save current rsp
-  current_ctx->rsp = rsp;
+  sp_ctx current_ctx = stack->current;
+  if (ctx != current_ctx) {
+    assert(get_ctx_id_of(stack, ctx) != INVALID_CTX_ID &&
+           "Target context not found");
+
+    // The target leaves the run queue (or is woken up if it was parked),
+    // the current context stays runnable unless it is parking
+    if (ctx->is_queued)
+      rq_remove(stack, ctx);
+    ctx->is_parked = false;
+
+    if (!current_ctx->is_parked)
+      rq_push_back(stack, current_ctx);
+  }
+
+  return switch_to(stack, ctx, value);
+}
+
+struct sp_switch _prepare_yield_ctx(sp_stack stack) {
+  if (stack->deferred.count > 0)
+    drain_deferred(stack);
+
+  sp_ctx current_ctx = stack->current;
+
+  run_tick(stack);
+
+  // Nothing else to run: resume the current context (possibly once its
+  // timer expired or its event arrived)
+  sp_ctx ctx = rq_pop(stack);
+  if (ctx == NULL && current_ctx->is_parked)
+    ctx = wait_events(stack);
+  if (ctx == NULL || ctx == current_ctx) {
+    assert(!current_ctx->is_parked && "Deadlock: every context is parked");
+    return switch_to(stack, current_ctx, NULL);
+  }
+
+  // A parked context whose timer just expired is queued already
+  if (!current_ctx->is_parked && !current_ctx->is_queued)
+    rq_push_back(stack, current_ctx);
+
+  return switch_to(stack, ctx, NULL);
+}
 
-  size_t new_ctx_idx = get_ctx_id_of(stack, ctx);
-  assert(new_ctx_idx != INVALID_CTX_ID && "Target context not found");
-  stack->current_index = new_ctx_idx;
+#ifndef SP_INLINE_SWITCH
+// Out-of-line switch: the platform switch_ctx/yield_ctx entry points push the
+// callee-saved registers and jump here with the resulting stack pointer
 
-  // Switch contexts
-  _asm_restore_ctx(ctx->rsp);
+__attribute__((noreturn)) void transfer_ctx_inner(sp_stack stack, sp_ctx ctx,
+                                                  void *value, void *rsp) {
+  struct sp_switch sw = _prepare_switch_ctx(stack, ctx, value);
+  if (sw.save != NULL)
+    *sw.save = rsp;
 
+  _asm_restore_ctx(sw.save != NULL ? sw.rsp : rsp, value);
   abort(); // Unreachable
 }
 
+__attribute__((noreturn)) void switch_ctx_inner(sp_stack stack, sp_ctx ctx,
+                                                void *rsp) {
+  transfer_ctx_inner(stack, ctx, NULL, rsp);
+}
+
 __attribute__((noreturn)) void yield_ctx_inner(sp_stack stack, void *rsp) {
+  struct sp_switch sw = _prepare_yield_ctx(stack);
+  if (sw.save != NULL)
+    *sw.save = rsp;
+
+  _asm_restore_ctx(sw.save != NULL ? sw.rsp : rsp, NULL);
+  abort(); // Unreachable
+}
+#endif // SP_INLINE_SWITCH
+
+/**
+ * @brief Set up a freshly allocated context and queue it
+ * @param stack The stack the context belongs to
+ * @param ctx A context returned by alloc_ctx, map_ctx or new_ctx
+ * @param fn The coroutine function
+ * @param arg The argument to the coroutine function
+ * @return ctx
+ */
+static sp_ctx start_ctx(sp_stack stack, sp_ctx ctx, sp_func fn, void *arg) {
+  ctx->fn = fn;
+  ctx->arg = arg;
 
-  sp_ctx current_ctx = stack->active_ctxs.items[stack->current_index];
-  // Save current rsp
-  current_ctx->rsp = rsp;
+  // Lazy contexts are mapped and primed on first resume (see resume_rsp)
+  if (ctx->stack_base != NULL)
+    prime_ctx(stack, ctx);
+  else
+    ctx->rsp = NULL;
 
-  if (stack->current_index == 0) {
-    stack->current_index =
-        stack->active_ctxs.count - 1; // Switch to last context
-  } else {
-    stack->current_index--; // Switch to previous context
+  ctx->is_done = false;
+  ctx->is_parked = false;
+  ctx->is_detached = false;
+  ctx->waiters = NULL;
+  ctx->result = NULL;
+  ctx->name = NULL;
+  ctx->run_epoch = stack->scavenge_epoch;
+  ctx->idle_since = 0;
+  ctx->is_timed = false;
+
+  add_active_ctx(stack, ctx);
+  // Newly created contexts wait for their turn like the others: queued at
+  // the front, a coroutine spawning in a loop would starve the run queue
+  rq_push_back(stack, ctx);
+
+  return ctx;
+}
+
+/**
+ * @brief Release the resident pages of a stack range
+ * @param low Lowest address of the range (rounded up to a page)
+ * @param high End of the range (rounded down to a page)
+ * @return Bytes of resident memory released
+ */
+static size_t release_idle_pages(const char *low, const char *high) {
+  uintptr_t page = (uintptr_t)getpagesize();
+  uintptr_t start = ((uintptr_t)low + page - 1) & ~(page - 1);
+  uintptr_t end = (uintptr_t)high & ~(page - 1);
+#ifdef __APPLE__
+  char resident[64];
+#else
+  unsigned char resident[64];
+#endif
+
+  if (end <= start)
+    return 0;
+
+  // Only count (and only advise) what is actually resident
+  size_t pages = (end - start) / page;
+  size_t released = 0;
+  for (size_t first = 0; first < pages; first += sizeof(resident)) {
+    size_t count = pages - first;
+    if (count > sizeof(resident))
+      count = sizeof(resident);
+
+    if (mincore((void *)(start + first * page), count * page, resident) != 0)
+      return 0;
+    for (size_t i = 0; i < count; i++)
+      released += resident[i] & 1;
   }
 
-  sp_ctx ctx = stack->active_ctxs.items[stack->current_index];
+  if (released == 0 ||
+      madvise((void *)start, end - start, SCAVENGE_ADVICE) != 0)
+    return 0;
 
-  // Switch contexts
-  _asm_restore_ctx(ctx->rsp);
+  return released * page;
+}
 
-  abort(); // Unreachable
+/**
+ * @brief Release the idle pages of a context if it has been idle long enough
+ * @param ctx A suspended or pooled context with a stack of its own
+ * @param now Current monotonic time in nanoseconds
+ * @param idle_ns Idle time after which pages are released
+ * @param pooled Whether the context sits in the pool (its whole stack is
+ * dead) rather than suspended (only the part below its saved rsp is)
+ * @return Bytes released
+ */
+static size_t scavenge_ctx(sp_ctx ctx, uint64_t now, uint64_t idle_ns,
+                           bool pooled) {
+  sp_stack stack = ctx->stack;
+
+  if (ctx->is_user_stack || ctx->stack_base == NULL || ctx->rsp == NULL)
+    return 0;
+
+  // Switched out since the previous pass: idle from now on
+  if (!pooled && ctx->run_epoch == stack->scavenge_epoch)
+    ctx->idle_since = now;
+  else if (ctx->idle_since == 0)
+    ctx->idle_since = now;
+
+  if (ctx->idle_since == SCAVENGED || now - ctx->idle_since < idle_ns)
+    return 0;
+  ctx->idle_since = SCAVENGED;
+
+  char *base = ctx->stack_base;
+  char *top = base + ctx->stack_size;
+  char *end = pooled ? top : ctx->rsp;
+
+  if (stack->flags & SP_STACK_HIGH_WATER) {
+    if (pooled) {
+      // Only the kept top page still needs clearing on reuse
+      uintptr_t kept = (uintptr_t)top & ((uintptr_t)getpagesize() - 1);
+      if (ctx->high_water > kept)
+        ctx->high_water = kept;
+    } else {
+      ctx->high_water = ctx_stack_high_water(ctx);
+    }
+  }
+
+  return release_idle_pages(base, end);
 }
 
 /* Public Functions */
 
 sp_stack init_stack(size_t stack_capacity) {
+  return init_stack_ex(stack_capacity, 0);
+}
+
+sp_stack init_stack_ex(size_t stack_capacity, unsigned flags) {
   if (stack_capacity == 0)
     stack_capacity = STACK_CAPACITY;
+  // Whole pages, as for create_ctx_ex, so that stack tops stay aligned
+  size_t page = (size_t)getpagesize();
+  stack_capacity = (stack_capacity + page - 1) & ~(page - 1);
 
   sp_stack stack = malloc(sizeof(*stack));
   da_init(&stack->active_ctxs);
+  da_init(&stack->inactive_ctxs);
+  da_init(&stack->deferred);
 
-  stack->current_index = 0;
+  stack->rq_head = NULL;
+  stack->rq_tail = NULL;
+  stack->rq_count = 0;
   stack->stack_size = stack_capacity;
+  stack->pool_low = POOL_LOW_WATERMARK;
+  stack->pool_high = POOL_HIGH_WATERMARK;
+  stack->flags = flags;
+  stack->arena = (flags & SP_STACK_ARENA) ? arena_create() : NULL;
+  stack->next_guarded = NULL;
+  stack->is_guarded = false;
+  stack->shared = NULL;
+  stack->high_water = 0;
+  stack->prefault = 0;
+  stack->scavenge_epoch = 0;
+  stack->scavenged = 0;
+  stack->timers = NULL;
+  stack->tick_skip = 0;
+  stack->poller = NULL;
+  stack->poller_arg = NULL;
+
+  assert(!((flags & SP_STACK_ARENA) && (flags & SP_STACK_SHARED)) &&
+         "SP_STACK_ARENA and SP_STACK_SHARED are exclusive");
+
+  if (flags & SP_STACK_SHARED) {
+    size_t guard = (flags & SP_STACK_GUARD) ? STACK_GUARD_SIZE : 0;
+    stack->shared = shared_create(stack_capacity, guard);
+  }
+
+  if (flags & SP_STACK_GUARD)
+    register_guarded_stack(stack);
 
   // Setup main context (caller thread)
   sp_ctx ctx = malloc(sizeof(*ctx));
   ctx->rsp = NULL;
   ctx->stack_base = NULL;
+  ctx->is_done = false;
+  ctx->stack_size = 0;
+  ctx->guard_size = 0;
+  ctx->is_queued = false;
+  ctx->is_parked = false;
+  ctx->is_detached = false;
+  ctx->waiters = NULL;
+  ctx->result = NULL;
+  ctx->high_water = 0;
+  ctx->stack = stack;
+  ctx->fn = NULL;
+  ctx->name = NULL;
+  ctx->is_custom = false;
+  ctx->is_user_stack = false;
+  ctx->is_embedded = false;
+  ctx->run_epoch = 0;
+  ctx->idle_since = 0;
+  ctx->is_timed = false;
 
-  da_append(&stack->active_ctxs, ctx);
+  add_active_ctx(stack, ctx);
+  stack->current = ctx;
 
   return stack;
 }
 
 void deinit_stack(sp_stack stack) {
+  drain_deferred(stack);
   assert(stack->active_ctxs.count == 1 &&
          "All coroutines must be destroyed before deinitializing the stack");
 
   free(stack->active_ctxs
            .items[0]); // Destroy main context (only free as no mmap was used)
 
+  trim_pool(stack, 0);
+  if (stack->is_guarded)
+    unregister_guarded_stack(stack);
+  if (stack->arena != NULL)
+    arena_destroy(stack->arena);
+  if (stack->shared != NULL)
+    shared_destroy(stack->shared);
+
   da_free(&stack->active_ctxs);
+  da_free(&stack->inactive_ctxs);
+  da_free(&stack->deferred);
+  free(stack->timers);
   free(stack);
 }
 
@@ -182,46 +1583,125 @@ void deinit_stack(sp_stack stack) {
  * @return sp_ctx The created coroutine context
  */
 sp_ctx create_ctx(sp_stack stack, sp_func fn, void *arg) {
-  sp_ctx ctx = malloc(sizeof(*ctx));
-  ctx->stack_size = stack->stack_size;
+  // Reuse the stacks of finished detached contexts first
+  if (stack->deferred.count > 0)
+    drain_deferred(stack);
 
-  int prot = PROT_WRITE | PROT_READ;
-  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
-#ifdef MAP_STACK
-  flags |= MAP_STACK;
-#endif
-#ifdef MAP_GROWSDOWN
-  flags |= MAP_GROWSDOWN;
-#endif
+  return start_ctx(stack, alloc_ctx(stack, stack->flags & SP_STACK_LAZY), fn,
+                   arg);
+}
 
-  ctx->stack_base = mmap(NULL, ctx->stack_size, prot, flags, -1, 0);
-  assert(ctx->stack_base != MAP_FAILED &&
-         "Failed to allocate stack for coroutine");
+sp_ctx create_ctx_ex(sp_stack stack, sp_func fn, void *arg,
+                     const sp_ctx_attr *attr) {
+  if (attr == NULL)
+    return create_ctx(stack, fn, arg);
 
-  ctx->rsp = platform_setup_stack((char *)ctx->stack_base + stack->stack_size,
-                                  fn, stack, arg);
-  ctx->is_done = false;
+  if (stack->deferred.count > 0)
+    drain_deferred(stack);
 
-  da_append(&stack->active_ctxs, ctx);
+  size_t guard = (stack->flags & SP_STACK_GUARD) ? STACK_GUARD_SIZE : 0;
+  if (attr->guard != SP_GUARD_DEFAULT)
+    guard = attr->guard == SP_GUARD_ON ? STACK_GUARD_SIZE : 0;
+  size_t size = attr->stack_size != 0 ? attr->stack_size : stack->stack_size;
+  // Mapped stacks end where their size does: rounded to whole pages, the
+  // stack top and the embedded context stay aligned
+  size_t page = (size_t)getpagesize();
+  size = (size + page - 1) & ~(page - 1);
+  // Pre-faulting asks for the stack now, so it overrides SP_STACK_LAZY
+  bool lazy = (stack->flags & SP_STACK_LAZY) && attr->prefault == 0;
+
+  sp_ctx ctx;
+  if (attr->stack == NULL && size == stack->stack_size &&
+      (guard > 0) == ((stack->flags & SP_STACK_GUARD) != 0)) {
+    // Default geometry: served by the pool like create_ctx
+    ctx = alloc_ctx(stack, lazy);
+  } else {
+    assert(stack->shared == NULL &&
+           "Shared stack contexts cannot have a stack of their own");
+
+    if (guard > 0 && attr->stack == NULL && !stack->is_guarded)
+      register_guarded_stack(stack);
+
+    if (attr->stack != NULL) {
+      assert(attr->stack_size > 0 && "User stack memory needs a stack_size");
+      assert(attr->guard != SP_GUARD_ON &&
+             "Guard pages cannot be added to user stack memory");
+      uintptr_t top = ((uintptr_t)attr->stack + attr->stack_size) & ~(uintptr_t)15;
+      ctx = new_ctx(stack);
+      ctx->is_user_stack = true;
+      ctx->stack_base = attr->stack;
+      ctx->stack_size = top - (uintptr_t)attr->stack;
+      ctx->guard_size = 0;
+      // Unlike fresh mappings, caller memory may hold anything: clear it so
+      // ctx_stack_high_water does not count stale bytes as used
+      if (stack->flags & SP_STACK_HIGH_WATER)
+        memset(ctx->stack_base, 0, ctx->stack_size);
+    } else if (lazy) {
+      ctx = new_ctx(stack);
+      ctx->stack_base = NULL;
+      ctx->stack_size = size;
+      ctx->guard_size = guard;
+    } else {
+      ctx = map_ctx(stack, size, guard);
+    }
 
+    ctx->is_custom = true;
+  }
+
+  if (attr->prefault > stack->prefault && stack->shared == NULL)
+    prefault_stack(ctx->stack_base, ctx->stack_size, attr->prefault);
+
+  ctx = start_ctx(stack, ctx, fn, arg);
+  ctx->name = attr->name;
   return ctx;
 }
 
+const char *get_ctx_name(sp_ctx ctx) {
+  return ctx != NULL ? ctx->name : NULL; // The main context has no name
+}
+
 void unregister_ctx(sp_stack stack, sp_ctx ctx) {
   assert(ctx != get_ctx(stack) && "Cannot unregister main or current context");
+  assert(!ctx->is_timed && "Cannot unregister a context with a timer");
 
   size_t idx = get_ctx_id_of(stack, ctx);
   if (idx != INVALID_CTX_ID) {
-    da_fast_remove(&stack->active_ctxs, idx);
-    if (stack->current_index >= idx && stack->current_index > 0) {
-      stack->current_index--;
-    }
+    remove_active_ctx(stack, idx);
+    if (ctx->is_queued)
+      rq_remove(stack, ctx);
+  }
+}
+
+void register_ctx(sp_stack stack, sp_ctx ctx) {
+  assert(ctx != NULL && !ctx->is_done && ctx->slot == INVALID_CTX_ID &&
+         "Only unregistered, unfinished contexts can be registered");
+
+  if (ctx->stack != stack) {
+    // The new stack becomes responsible for recycling the stack memory
+    assert(ctx->stack->arena == NULL && ctx->stack->shared == NULL &&
+           stack->arena == NULL && stack->shared == NULL &&
+           "Arena and shared stack contexts cannot change stack");
+    assert((ctx->is_custom || (ctx->stack->stack_size == stack->stack_size &&
+                               ctx->stack->flags == stack->flags)) &&
+           "Stack geometry mismatch");
+    if (ctx->guard_size > 0 && !stack->is_guarded)
+      register_guarded_stack(stack);
+    ctx->stack = stack;
+    ctx->idle_since = 0; // Epochs of the previous stack do not apply
   }
+
+  add_active_ctx(stack, ctx);
+  ctx->is_parked = false;
+  rq_push_back(stack, ctx);
 }
 
 /**
  * @brief Destroy a coroutine context
  *
+ * The context is returned to the pool of its stack so that the next
+ * create_ctx can reuse it. When the pool grows past its high watermark it is
+ * trimmed down to its low watermark.
+ *
  * @param ctx The coroutine context to destroy
  *
  * @warning Cannot destroy the main context or a non-finished context
@@ -230,8 +1710,178 @@ void destroy_ctx(sp_ctx ctx) {
   assert(ctx != NULL && "Cannot destroy main context");
   assert(ctx->is_done && "Cannot destroy a non-finished context");
 
-  munmap(ctx->stack_base, ctx->stack_size);
-  free(ctx);
+  sp_stack stack = ctx->stack;
+
+  // Keep the peak usage in the stack aggregate before recycling
+  if (stack->flags & SP_STACK_HIGH_WATER) {
+    size_t used = ctx_stack_high_water(ctx);
+    if (used > stack->high_water)
+      stack->high_water = used;
+    ctx->high_water = stack->shared != NULL ? 0 : used;
+  }
+
+  ctx->idle_since = 0; // Idle in the pool from the next scavenge_stack
+
+  // Only default stacks can serve the next create_ctx
+  if (ctx->is_custom) {
+    release_ctx(ctx);
+    return;
+  }
+
+  da_append(&stack->inactive_ctxs, ctx);
+
+  if (stack->inactive_ctxs.count > stack->pool_high)
+    trim_pool(stack, stack->pool_low);
+}
+
+void detach_ctx(sp_ctx ctx) {
+  assert(ctx != NULL && "Cannot detach main context");
+  assert(!ctx->is_detached && "Context is already detached");
+
+  if (ctx->is_done) {
+    destroy_ctx(ctx);
+    return;
+  }
+
+  ctx->is_detached = true;
+}
+
+void set_pool_watermarks(sp_stack stack, size_t low, size_t high) {
+  assert(low <= high && "Low watermark must not exceed high watermark");
+
+  stack->pool_low = low;
+  stack->pool_high = high;
+
+  if (stack->inactive_ctxs.count > high)
+    trim_pool(stack, low);
+}
+
+size_t prewarm_pool(sp_stack stack, size_t count) {
+  assert(stack->shared == NULL && "Shared stack contexts have no own stack");
+
+  size_t guard = (stack->flags & SP_STACK_GUARD) ? STACK_GUARD_SIZE : 0;
+  size_t mapped = 0;
+
+  while (stack->inactive_ctxs.count < count) {
+    da_append(&stack->inactive_ctxs, map_ctx(stack, stack->stack_size, guard));
+    mapped++;
+  }
+
+  return mapped;
+}
+
+void set_stack_prefault(sp_stack stack, size_t bytes) {
+  stack->prefault = bytes;
+
+  // The shared stack is mapped once, so it is faulted in right away
+  if (stack->shared != NULL && bytes > 0)
+    prefault_stack(stack->shared->base, stack->shared->size, bytes);
+}
+
+size_t scavenge_stack(sp_stack stack, uint64_t idle_ns) {
+  // Contexts of a shared stack have no pages of their own
+  if (stack->shared != NULL)
+    return 0;
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  uint64_t now = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+
+  size_t released = 0;
+  // Context 0 is the main context, which runs on the thread stack
+  for (size_t i = 1; i < stack->active_ctxs.count; i++) {
+    sp_ctx ctx = stack->active_ctxs.items[i];
+    if (ctx != stack->current && !ctx->is_done)
+      released += scavenge_ctx(ctx, now, idle_ns, false);
+  }
+  for (size_t i = 0; i < stack->inactive_ctxs.count; i++)
+    released += scavenge_ctx(stack->inactive_ctxs.items[i], now, idle_ns,
+                             true);
+
+  stack->scavenge_epoch++;
+  stack->scavenged += released;
+  return released;
+}
+
+size_t get_scavenged_bytes(sp_stack stack) { return stack->scavenged; }
+
+size_t trim_pool(sp_stack stack, size_t keep) {
+  size_t released = 0;
+
+  while (stack->inactive_ctxs.count > keep) {
+    release_ctx(stack->inactive_ctxs.items[--stack->inactive_ctxs.count]);
+    released++;
+  }
+
+  return released;
+}
+
+void park_ctx(sp_stack stack) {
+  // yield_ctx leaves parked contexts out of the run queue
+  stack->current->is_parked = true;
+  yield_ctx(stack);
+}
+
+bool park_ctx_until(sp_stack stack, uint64_t deadline) {
+  if (stack->timers == NULL) {
+    stack->timers = calloc(1, sizeof(*stack->timers));
+    assert(stack->timers != NULL && "Maybe you should buy more RAM");
+  }
+
+  // The scheduler keeps the wheel within a pass of the clock while timers
+  // are pending; an idle wheel may be far behind
+  struct s_timer_wheel *wheel = stack->timers;
+  if (wheel->count == 0) {
+    timer_advance(stack, clock_ns() >> TIMER_TICK_SHIFT);
+    stack->tick_skip = 0;
+  }
+
+  // Rounded up: a timer never fires before its deadline
+  uint64_t expires = (deadline >> TIMER_TICK_SHIFT) +
+                     ((deadline & ((1ull << TIMER_TICK_SHIFT) - 1)) != 0);
+  if (expires <= wheel->now)
+    return false;
+
+  sp_ctx ctx = stack->current;
+  ctx->deadline = expires;
+  ctx->is_timed = true;
+  ctx->is_timed_out = false;
+  timer_link(wheel, ctx);
+  wheel->count++;
+
+  park_ctx(stack);
+
+  if (ctx->is_timed)
+    timer_unlink(wheel, ctx);
+  return !ctx->is_timed_out;
+}
+
+void sleep_ctx(sp_stack stack, uint64_t ns) {
+  uint64_t deadline = clock_ns() + ns;
+
+  // Spurious unpark_ctx are ignored
+  while (park_ctx_until(stack, deadline))
+    ;
+}
+
+uint64_t get_time_ns(void) { return clock_ns(); }
+
+void set_stack_poller(sp_stack stack, sp_poll_func fn, void *arg) {
+  assert((fn == NULL || stack->poller == NULL) &&
+         "The stack already has a poller");
+  stack->poller = fn;
+  stack->poller_arg = arg;
+}
+
+void unpark_ctx(sp_stack stack, sp_ctx ctx) {
+  if (ctx == NULL)
+    ctx = stack->active_ctxs.items[0]; // Main context
+
+  if (!ctx->is_parked)
+    return;
+
+  ctx->is_parked = false;
+  rq_push_back(stack, ctx);
 }
 
 bool is_ctx_finished(sp_ctx ctx) {
@@ -242,10 +1892,182 @@ bool is_ctx_finished(sp_ctx ctx) {
 }
 
 sp_ctx get_ctx(sp_stack stack) {
-  size_t idx = get_ctx_id(stack);
-  if (idx == 0)
+  if (stack->current->slot == 0)
     return NULL; // Main context
 
-  assert(idx != INVALID_CTX_ID && "No current context");
-  return stack->active_ctxs.items[idx];
+  return stack->current;
+}
+
+void set_ctx_result(sp_stack stack, void *result) {
+  stack->current->result = result;
+}
+
+void *get_ctx_result(sp_ctx ctx) {
+  assert(ctx != NULL && ctx->is_done && "Context has not finished");
+  return ctx->result;
+}
+
+size_t ctx_stack_high_water(sp_ctx ctx) {
+  assert(ctx != NULL && "The main context is not measured");
+  sp_stack stack = ctx->stack;
+  assert((stack->flags & SP_STACK_HIGH_WATER) &&
+         "Stack was not created with SP_STACK_HIGH_WATER");
+
+  if (stack->shared != NULL)
+    return ctx->high_water;
+  if (ctx->stack_base == NULL)
+    return 0; // Lazy context that never ran
+
+  // Pages released by scavenge_stack read back as zeros
+  size_t used = scan_high_water(ctx->stack_base, ctx->stack_size);
+  return used > ctx->high_water ? used : ctx->high_water;
+}
+
+size_t stack_high_water(sp_stack stack) {
+  assert((stack->flags & SP_STACK_HIGH_WATER) &&
+         "Stack was not created with SP_STACK_HIGH_WATER");
+
+  if (stack->shared != NULL)
+    return scan_high_water(stack->shared->base, stack->shared->size);
+
+  size_t used = stack->high_water;
+  for (size_t i = 1; i < stack->active_ctxs.count; i++) {
+    size_t ctx_used = ctx_stack_high_water(stack->active_ctxs.items[i]);
+    if (ctx_used > used)
+      used = ctx_used;
+  }
+
+  return used;
+}
+
+void *await_ctx(sp_stack stack, sp_ctx ctx) {
+  assert(ctx != NULL && "Main context never finishes");
+
+  if (!ctx->is_done) {
+    sp_ctx current_ctx = stack->current;
+    assert(ctx != current_ctx && "A context cannot await itself");
+
+    current_ctx->wait_next = ctx->waiters;
+    ctx->waiters = current_ctx;
+
+    // coroutine_finish resumes us (spurious unpark_ctx are ignored)
+    while (!ctx->is_done)
+      park_ctx(stack);
+  }
+
+  return ctx->result;
+}
+
+/**
+ * @brief Entry point of a generator coroutine
+ *
+ * When the generator function returns, the consumer parked in gen_next is
+ * queued first so that coroutine_finish resumes it right away.
+ */
+static void gen_entry(sp_stack stack, void *arg) {
+  sp_gen gen = arg;
+  gen->fn(gen, gen->arg);
+
+  // The consumer may be queued already after a spurious unpark_ctx
+  if (gen->consumer->is_queued)
+    rq_remove(stack, gen->consumer);
+  gen->consumer->is_parked = false;
+  rq_push_front(stack, gen->consumer);
+}
+
+/**
+ * @brief Destroy a suspended context that will never be resumed
+ *
+ * Its frames are dropped without being unwound, so whatever they own is
+ * leaked.
+ */
+static void discard_ctx(sp_stack stack, sp_ctx ctx) {
+  assert(ctx != stack->current && "Cannot discard the running context");
+  assert(ctx->waiters == NULL && !ctx->is_timed &&
+         "Cannot discard an awaited or timed context");
+
+  if (ctx->is_queued)
+    rq_remove(stack, ctx);
+  if (stack->shared != NULL && stack->shared->owner == ctx)
+    stack->shared->owner = NULL;
+  remove_active_ctx(stack, ctx->slot);
+  ctx->is_parked = false;
+  ctx->is_done = true;
+
+  // A lazy context that never ran has no stack to recycle
+  if (ctx->stack_base == NULL) {
+    free(ctx);
+    return;
+  }
+
+  destroy_ctx(ctx);
+}
+
+sp_gen gen_create(sp_stack stack, sp_gen_func fn, void *arg) {
+  sp_gen gen = malloc(sizeof(*gen));
+  gen->stack = stack;
+  gen->consumer = NULL;
+  gen->value = NULL;
+  gen->is_pulling = false;
+  gen->fn = fn;
+  gen->arg = arg;
+  gen->ctx = create_ctx(stack, gen_entry, gen);
+
+  // Only gen_next resumes the generator
+  rq_remove(stack, gen->ctx);
+  gen->ctx->is_parked = true;
+
+  return gen;
+}
+
+void *gen_next(sp_gen gen) {
+  if (gen->ctx == NULL)
+    return NULL; // Already finished
+
+  // The consumer waits parked: only gen_yield or the end of the generator
+  // resumes it
+  sp_stack stack = gen->stack;
+  gen->consumer = stack->current;
+  gen->consumer->is_parked = true;
+  gen->value = NULL;
+  gen->is_pulling = true;
+
+  transfer_ctx(stack, gen->ctx, NULL);
+
+  // Spurious unpark_ctx are ignored
+  while (gen->value == NULL && !gen->ctx->is_done)
+    park_ctx(stack);
+  gen->is_pulling = false;
+
+  if (gen->ctx->is_done) {
+    // Recycle the generator stack as soon as the iteration is over
+    destroy_ctx(gen->ctx);
+    gen->ctx = NULL;
+    return NULL;
+  }
+
+  return gen->value;
+}
+
+void gen_yield(sp_gen gen, void *value) {
+  assert(value != NULL && "Generators cannot yield NULL");
+  assert(gen->stack->current == gen->ctx &&
+         "gen_yield must be called from its generator");
+
+  gen->value = value;
+  gen->ctx->is_parked = true;
+  transfer_ctx(gen->stack, gen->consumer, value);
+}
+
+bool is_gen_finished(sp_gen gen) { return gen->ctx == NULL; }
+
+void gen_destroy(sp_gen gen) {
+  assert(!gen->is_pulling && "Cannot destroy a generator during gen_next");
+
+  // Stopped early: the generator is suspended in gen_yield (or has not
+  // started), and is dropped there
+  if (gen->ctx != NULL)
+    discard_ctx(gen->stack, gen->ctx);
+
+  free(gen);
 }
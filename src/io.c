@@ -0,0 +1,355 @@
+#include <assert.h>
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "coroutine.h"
+
+/* Private Types */
+
+// Operation a context is parked on. Records live on the heap, recycled
+// through a free list, rather than on the parked coroutine's stack.
+struct s_io_op {
+  sp_ctx ctx; // Parked context (NULL for main context)
+  int res;    // Result of the completion (negative errno on failure)
+  bool done;
+  struct s_io_op *next; // Next free record
+};
+
+struct s_reactor {
+  sp_stack stack;
+  int fd;
+
+  // Submission queue, shared with the kernel
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  unsigned sq_entries;
+  struct io_uring_sqe *sqes;
+
+  // Completion queue, shared with the kernel
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  struct io_uring_cqe *cqes;
+
+  // Mappings
+  void *sq_ring;
+  size_t sq_ring_size;
+  void *cq_ring; // Same as sq_ring with IORING_FEAT_SINGLE_MMAP
+  size_t cq_ring_size;
+  size_t sqes_size;
+
+  size_t pending;  // Operations queued or submitted, not completed yet
+  size_t enters;   // io_uring_enter calls
+  size_t submits;  // io_uring_enter calls that submitted entries
+  struct s_io_op *free_ops;
+};
+
+// Default number of submission queue entries
+#ifndef REACTOR_ENTRIES
+#define REACTOR_ENTRIES 256
+#endif // REACTOR_ENTRIES
+
+/* Private Functions */
+
+/**
+ * @brief Map a ring of the io_uring instance
+ * @return The mapping, or MAP_FAILED
+ */
+static void *map_ring(int fd, size_t size, uint64_t offset) {
+  return mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+              fd, (off_t)offset);
+}
+
+static void unmap_rings(sp_reactor reactor) {
+  if (reactor->sqes != MAP_FAILED)
+    munmap(reactor->sqes, reactor->sqes_size);
+  if (reactor->cq_ring != reactor->sq_ring && reactor->cq_ring != MAP_FAILED)
+    munmap(reactor->cq_ring, reactor->cq_ring_size);
+  if (reactor->sq_ring != MAP_FAILED)
+    munmap(reactor->sq_ring, reactor->sq_ring_size);
+}
+
+static unsigned sq_queued(sp_reactor reactor) {
+  return *reactor->sq_tail - __atomic_load_n(reactor->sq_head,
+                                             __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Complete the queued entries the kernel refused with an error
+ *
+ * The kernel has not read them (sq_head did not move past them), so they are
+ * taken back from the ring and their contexts resumed with `res`.
+ */
+static void fail_queued(sp_reactor reactor, int res) {
+  unsigned head = __atomic_load_n(reactor->sq_head, __ATOMIC_ACQUIRE);
+  unsigned tail = *reactor->sq_tail;
+
+  for (unsigned i = head; i != tail; i++) {
+    unsigned index = reactor->sq_array[i & *reactor->sq_mask];
+    struct s_io_op *op =
+        (struct s_io_op *)(uintptr_t)reactor->sqes[index].user_data;
+
+    op->res = res;
+    op->done = true;
+    reactor->pending--;
+    unpark_ctx(reactor->stack, op->ctx);
+  }
+
+  __atomic_store_n(reactor->sq_tail, head, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Submit the queued entries and optionally wait for a completion
+ *
+ * Interrupted calls are restarted. When the kernel is short of room for
+ * completions (EBUSY) or memory (EAGAIN), the entries stay queued: reaping
+ * the completion queue and calling again resolves it. Any other error fails
+ * the queued operations with it.
+ *
+ * @param timeout_ns Nanoseconds to wait (0 to not wait, SP_POLL_FOREVER)
+ */
+static void ring_enter(sp_reactor reactor, uint64_t timeout_ns) {
+  unsigned flags = 0;
+  struct __kernel_timespec ts = {(long long)(timeout_ns / 1000000000ull),
+                                 (long long)(timeout_ns % 1000000000ull)};
+  struct io_uring_getevents_arg arg = {0};
+  if (timeout_ns > 0) {
+    flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    arg.ts = timeout_ns == SP_POLL_FOREVER ? 0 : (uint64_t)(uintptr_t)&ts;
+  }
+
+  long ret;
+  do {
+    ret = syscall(__NR_io_uring_enter, reactor->fd, sq_queued(reactor),
+                  timeout_ns > 0 ? 1 : 0, flags, timeout_ns > 0 ? &arg : NULL,
+                  timeout_ns > 0 ? sizeof(arg) : 0);
+    reactor->enters++;
+  } while (ret < 0 && errno == EINTR);
+
+  // Entries the kernel did not take (short count) stay queued for the next
+  // call. ETIME: the wait expired, which is not an error here.
+  if (ret > 0)
+    reactor->submits++;
+  if (ret >= 0 || errno == ETIME || errno == EBUSY || errno == EAGAIN)
+    return;
+
+  // The instance itself is unusable (bad descriptor, bad arguments):
+  // submitted operations would never complete
+  int err = errno;
+  fail_queued(reactor, -err);
+  assert(reactor->pending == 0 && "io_uring_enter failed with I/O in flight");
+}
+
+/**
+ * @brief Hand the results of the completed operations to their contexts
+ */
+static void reap(sp_reactor reactor) {
+  unsigned head = *reactor->cq_head;
+  unsigned tail = __atomic_load_n(reactor->cq_tail, __ATOMIC_ACQUIRE);
+
+  for (; head != tail; head++) {
+    struct io_uring_cqe *cqe = &reactor->cqes[head & *reactor->cq_mask];
+    struct s_io_op *op = (struct s_io_op *)(uintptr_t)cqe->user_data;
+
+    op->res = cqe->res;
+    op->done = true;
+    reactor->pending--;
+    unpark_ctx(reactor->stack, op->ctx);
+  }
+
+  __atomic_store_n(reactor->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Scheduler hook (see sp_poll_func): one io_uring_enter submits what
+ * the coroutines queued during the pass, and waits if asked to
+ */
+static bool reactor_poll(sp_stack stack, void *arg, uint64_t timeout_ns) {
+  (void)stack;
+  sp_reactor reactor = arg;
+  if (reactor->pending == 0)
+    return false;
+
+  // No need to wait if completions are already there
+  if (__atomic_load_n(reactor->cq_tail, __ATOMIC_ACQUIRE) !=
+      *reactor->cq_head)
+    timeout_ns = 0;
+
+  if (timeout_ns > 0 || sq_queued(reactor) > 0)
+    ring_enter(reactor, timeout_ns);
+
+  reap(reactor);
+  return reactor->pending > 0;
+}
+
+/**
+ * @brief Queue an operation and park until it completes
+ * @return Result of the operation (negative errno on failure)
+ */
+static int run_op(sp_reactor reactor, unsigned char opcode, int fd,
+                  const void *addr, unsigned len, uint64_t off) {
+  // Ring full: submit what is queued right away. If the kernel is short of
+  // room for completions, reaping them makes some.
+  while (sq_queued(reactor) == reactor->sq_entries) {
+    ring_enter(reactor, 0);
+    reap(reactor);
+  }
+
+  struct s_io_op *op = reactor->free_ops;
+  if (op != NULL) {
+    reactor->free_ops = op->next;
+  } else {
+    op = malloc(sizeof(*op));
+    assert(op != NULL && "Maybe you should buy more RAM");
+  }
+  op->ctx = get_ctx(reactor->stack);
+  op->done = false;
+
+  unsigned tail = *reactor->sq_tail;
+  unsigned index = tail & *reactor->sq_mask;
+  struct io_uring_sqe *sqe = &reactor->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)addr;
+  sqe->len = len;
+  sqe->off = off;
+  sqe->user_data = (uint64_t)(uintptr_t)op;
+  reactor->sq_array[index] = index;
+  __atomic_store_n(reactor->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  reactor->pending++;
+
+  // Submitted by the scheduler at the end of the pass; spurious unpark_ctx
+  // are ignored
+  while (!op->done)
+    park_ctx(reactor->stack);
+
+  int res = op->res;
+  op->next = reactor->free_ops;
+  reactor->free_ops = op;
+  return res;
+}
+
+static unsigned clamp_len(size_t len) {
+  return len > UINT32_MAX ? UINT32_MAX : (unsigned)len;
+}
+
+/* Public Functions */
+
+sp_reactor reactor_create(sp_stack stack, unsigned entries) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+
+  int fd = (int)syscall(__NR_io_uring_setup,
+                        entries > 0 ? entries : REACTOR_ENTRIES, &params);
+  if (fd < 0)
+    return NULL;
+
+  // Timed waits need IORING_ENTER_EXT_ARG (Linux 5.11)
+  if (!(params.features & IORING_FEAT_EXT_ARG)) {
+    close(fd);
+    return NULL;
+  }
+
+  sp_reactor reactor = calloc(1, sizeof(*reactor));
+  assert(reactor != NULL && "Maybe you should buy more RAM");
+  reactor->stack = stack;
+  reactor->fd = fd;
+  reactor->sq_entries = params.sq_entries;
+
+  // Failed mappings are unwound together below
+  reactor->sq_ring_size =
+      params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  reactor->cq_ring_size =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (reactor->cq_ring_size > reactor->sq_ring_size)
+      reactor->sq_ring_size = reactor->cq_ring_size;
+    reactor->sq_ring = map_ring(fd, reactor->sq_ring_size, IORING_OFF_SQ_RING);
+    reactor->cq_ring = reactor->sq_ring;
+  } else {
+    reactor->sq_ring = map_ring(fd, reactor->sq_ring_size, IORING_OFF_SQ_RING);
+    reactor->cq_ring = map_ring(fd, reactor->cq_ring_size, IORING_OFF_CQ_RING);
+  }
+  reactor->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  reactor->sqes = map_ring(fd, reactor->sqes_size, IORING_OFF_SQES);
+  if (reactor->sq_ring == MAP_FAILED || reactor->cq_ring == MAP_FAILED ||
+      reactor->sqes == MAP_FAILED) {
+    unmap_rings(reactor);
+    close(fd);
+    free(reactor);
+    return NULL;
+  }
+
+  char *sq = reactor->sq_ring;
+  reactor->sq_head = (unsigned *)(sq + params.sq_off.head);
+  reactor->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+  reactor->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+  reactor->sq_array = (unsigned *)(sq + params.sq_off.array);
+
+  char *cq = reactor->cq_ring;
+  reactor->cq_head = (unsigned *)(cq + params.cq_off.head);
+  reactor->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+  reactor->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+  reactor->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+  set_stack_poller(stack, reactor_poll, reactor);
+  return reactor;
+}
+
+void reactor_destroy(sp_reactor reactor) {
+  assert(reactor->pending == 0 && "Cannot destroy a reactor with pending I/O");
+  set_stack_poller(reactor->stack, NULL, NULL);
+
+  while (reactor->free_ops != NULL) {
+    struct s_io_op *op = reactor->free_ops;
+    reactor->free_ops = op->next;
+    free(op);
+  }
+
+  unmap_rings(reactor);
+  close(reactor->fd);
+  free(reactor);
+}
+
+size_t reactor_enter_count(sp_reactor reactor) { return reactor->enters; }
+
+size_t reactor_submit_count(sp_reactor reactor) { return reactor->submits; }
+
+ssize_t co_read(sp_reactor reactor, int fd, void *buf, size_t len,
+                off_t offset) {
+  return run_op(reactor, IORING_OP_READ, fd, buf, clamp_len(len),
+                (uint64_t)offset);
+}
+
+ssize_t co_write(sp_reactor reactor, int fd, const void *buf, size_t len,
+                 off_t offset) {
+  return run_op(reactor, IORING_OP_WRITE, fd, buf, clamp_len(len),
+                (uint64_t)offset);
+}
+
+int co_accept(sp_reactor reactor, int fd, struct sockaddr *addr,
+              socklen_t *addrlen) {
+  // The address length pointer travels in the offset field
+  return run_op(reactor, IORING_OP_ACCEPT, fd, addr, 0,
+                (uint64_t)(uintptr_t)addrlen);
+}
+
+int co_connect(sp_reactor reactor, int fd, const struct sockaddr *addr,
+               socklen_t addrlen) {
+  // The address length travels in the offset field
+  return run_op(reactor, IORING_OP_CONNECT, fd, addr, 0, addrlen);
+}
+
+int co_fsync(sp_reactor reactor, int fd) {
+  return run_op(reactor, IORING_OP_FSYNC, fd, NULL, 0, 0);
+}
@@ -1,7 +1,6 @@
 .global _asm_restore_ctx
+.global _coroutine_start
 .global _coroutine_finish
-.global yield_ctx
-.global switch_ctx
 
 /* Note: This implementation is for linux x86_64 architecture
 
@@ -13,70 +12,44 @@
     - First 6 integer/pointer arguments are passed in rdi, rsi, rdx, rcx, r8, r9
     - 7+ arguments are passed on the stack
 
+## Saved context:
+- The saved stack pointer points to the address to resume at. switch_ctx and
+  yield_ctx are inlined from coroutine.h: registers live across the switch
+  are spilled by the compiler, so resuming is only a stack pointer swap.
+- The value handed by transfer_ctx travels in rax.
+
 */
 
 
 /*
     * Restore Context stack.
     * Input: rdi - Context rsp address
+    * Input: rsi - Value handed to the context (returned by its transfer_ctx)
 */
 _asm_restore_ctx:
     movq %rdi, %rsp           /* Set stack pointer to context rsp */
+    movq %rsi, %rax           /* Hand the value over in rax */
 
-    popq %r15                 /* Restore r15 */
-    popq %r14                 /* Restore r14 */
-    popq %r13                 /* Restore r13 */
-    popq %r12                 /* Restore r12 */
-    popq %rbp                 /* Restore rbp */
-    popq %rbx                 /* Restore rbx */
-    popq %rsi                 /* Restore rsi */
-    popq %rdi                 /* Restore rdi */
+    /* By design the resume address is on top of the stack. It is popped and
+       jumped to rather than returned to, so that the return stack buffer of
+       the CPU stays in sync with the calls of the resumed context */
+    popq %rcx                 /* Resume address */
+    jmp *%rcx                 /* Jump to the restored context */
 
-    /* We can return here because by design the return address is on top of the stack */
-    ret                       /* Return to the restored context */
+/*
+    * Coroutine entry trampoline.
+    * Input: stack, arg and the coroutine function on top of the stack
+*/
+_coroutine_start:
+    popq %rdi                 /* First argument (stack) */
+    popq %rsi                 /* Second argument (arg) */
+    popq %rcx                 /* Coroutine function */
+    jmp *%rcx                 /* Jump to it, returning into _coroutine_finish */
 
 /*
     * Coroutine fishish trampoline.
-    * Input: stack - Pointer to the stack pointer
+    * Input: ctx - Finished coroutine context (on top of the stack)
 */
 _coroutine_finish:
-    popq %rdi                 /* Get the stack pointer address */
-    subq $8, %rsp             /* Align stack to 16 bytes */
+    popq %rdi                 /* Get the finished context (stack is now aligned as after a call) */
     jmp coroutine_finish      /* Jump to the finish handler */
-
-/*
-    * Switch Context stack.
-    * Input: rdi - Pointer to the stack context
-    * Input: rsi - Pointer to the target context rsp address
-*/
-switch_ctx:
-    pushq %rdi              /* Save rdi */
-    pushq %rsi              /* Save rsi */
-    pushq %rbx              /* Save rbx */
-    pushq %rbp              /* Save rbp */
-    pushq %r12              /* Save r12 */
-    pushq %r13              /* Save r13 */
-    pushq %r14              /* Save r14 */
-    pushq %r15              /* Save r15 */
-
-    movq %rsp, %rdx         /* Load new rsp from the context */
-
-    jmp switch_ctx_inner    /* Jump to inner switch function */
-
-/*
-    * Yield Context stack.
-    * Input: rdi - Pointer to the stack context
-*/
-yield_ctx:
-    pushq %rdi              /* Save rdi */
-    pushq %rsi              /* Save rsi */
-    pushq %rbx              /* Save rbx */
-    pushq %rbp              /* Save rbp */
-    pushq %r12              /* Save r12 */
-    pushq %r13              /* Save r13 */
-    pushq %r14              /* Save r14 */
-    pushq %r15              /* Save r15 */
-
-    movq %rsp, %rsi         /* Load new rsp from the context */
-
-    jmp yield_ctx_inner     /* Jump to inner yield function */
@@ -3,6 +3,7 @@
 .globl __coroutine_entry
 .globl __coroutine_finish
 .globl _switch_ctx
+.globl _transfer_ctx
 .globl _yield_ctx
 
 /* Note: This is for macOS on ARM64 (Apple Silicon)
@@ -14,9 +15,10 @@
     - Stack grows downwards
 */
 
-// Restore context from saved stack pointer (x0)
+// Restore context from saved stack pointer (x0), handing it the value in x1
 __asm_restore_ctx:
     mov     sp, x0
+    mov     x0, x1      // value returned by the resumed transfer_ctx
 
     ldp     x29, x30, [sp], #16
     ldp     x27, x28, [sp], #16
@@ -39,6 +41,19 @@ _switch_ctx:
     mov     x2, sp      // current stack pointer
     bl      _switch_ctx_inner
 
+// _transfer_ctx(sp_stack stack, sp_ctx ctx, void *value)
+// Saves callee-saved registers and jumps to _transfer_ctx_inner(stack, ctx, value, current_sp)
+_transfer_ctx:
+    stp     x19, x20, [sp, #-16]!
+    stp     x21, x22, [sp, #-16]!
+    stp     x23, x24, [sp, #-16]!
+    stp     x25, x26, [sp, #-16]!
+    stp     x27, x28, [sp, #-16]!
+    stp     x29, x30, [sp, #-16]!
+
+    mov     x3, sp      // current stack pointer
+    bl      _transfer_ctx_inner
+
 // _yield_ctx(sp_stack stack)
 // Saves callee-saved registers and jumps to _yield_ctx_inner(stack, current_sp)
 _yield_ctx:
@@ -53,7 +68,7 @@ _yield_ctx:
     bl      _yield_ctx_inner
 
 // Entry trampoline for a new coroutine
-// x19: stack, x20: arg, x21: fn, x22: coroutine_finish
+// x19: stack, x20: arg, x21: fn, x22: coroutine_finish, x23: ctx
 __coroutine_entry:
     mov     x0, x19      // stack
     mov     x1, x20      // arg
@@ -62,9 +77,9 @@ __coroutine_entry:
     br      x9
 
 // Finish trampoline for a coroutine
-// x19: stack pointer (sp_stack)
+// x23: finished context (sp_ctx, preserved by the coroutine function)
 __coroutine_finish:
-    mov     x0, x19           // stack
+    mov     x0, x23           // ctx
     b       _coroutine_finish // jump to finish function (non-returning)
     // Should not return here
     brk     #0
@@ -3,7 +3,7 @@
 extern void _coroutine_entry(void);
 extern void _coroutine_finish(void);
 
-void* platform_setup_stack(void* stack_top, sp_func fn, sp_stack stack, void* arg) {
+void* platform_setup_stack(void* stack_top, sp_func fn, sp_stack stack, void* arg, sp_ctx ctx) {
     // Stack grows down. We mirror the layout produced by yield/switch:
     // [x29][x30][x27][x28][x25][x26][x23][x24][x21][x22][x19][x20]
     // Registers are restored in that order, so we seed initial values.
@@ -16,7 +16,7 @@ void* platform_setup_stack(void* stack_top, sp_func fn, sp_stack stack, void* ar
 
     PUSH_PAIR(stack, arg);                 // x19, x20
     PUSH_PAIR(fn, _coroutine_finish);      // x21, x22
-    PUSH_PAIR(0, 0);                       // x23, x24
+    PUSH_PAIR(ctx, 0);                     // x23 (ctx for coroutine_finish), x24
     PUSH_PAIR(0, 0);                       // x25, x26
     PUSH_PAIR(0, 0);                       // x27, x28
     PUSH_PAIR(0, _coroutine_entry);        // x29 (fp), x30 (lr -> trampoline)
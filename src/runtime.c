@@ -0,0 +1,534 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "array.h"
+#include "coroutine.h"
+
+/* Private Types */
+
+struct s_task {
+  sp_task_func fn;
+  void *arg;
+  sp_runtime rt;
+  sp_ctx ctx;          // Created by the first worker running the task
+  struct s_task *next; // Injection queue link
+};
+
+// Circular buffer of a work-stealing deque
+struct s_deque_array {
+  int64_t size; // Always a power of two
+  _Atomic(struct s_task *) items[];
+};
+
+struct s_deque_arrays {
+  da_struct(struct s_deque_array *);
+};
+
+// Chase-Lev work-stealing deque: the owner pushes and takes at the bottom,
+// thieves steal from the top
+struct s_deque {
+  _Atomic int64_t top;
+  _Atomic int64_t bottom;
+  _Atomic(struct s_deque_array *) array;
+  // Arrays replaced by a resize, freed with the deque (thieves may still be
+  // reading them)
+  struct s_deque_arrays retired;
+};
+
+struct s_worker {
+  sp_runtime rt;
+  size_t id;
+  pthread_t thread;
+  sp_stack stack;
+  struct s_deque deque;
+  uint64_t seed; // Victim selection
+  uint64_t last_scavenge; // Time of the last scavenge_stack pass
+  size_t runs;            // Tasks run since the last clock read
+  _Atomic size_t scavenged; // Bytes released by scavenge_stack
+};
+
+struct s_runtime {
+  struct s_worker *workers;
+  size_t worker_count;
+  size_t stack_capacity;
+
+  // Tasks spawned from outside the workers
+  pthread_mutex_t inject_lock;
+  struct s_task *inject_head;
+  struct s_task *inject_tail;
+
+  _Atomic size_t queued;  // Tasks waiting in a deque or the injection queue
+  _Atomic size_t pending; // Spawned tasks not finished yet
+  _Atomic size_t sleeping;
+  _Atomic bool stopping;
+  _Atomic uint64_t scavenge_idle_ns; // See set_runtime_scavenge (0: off)
+
+  pthread_mutex_t lock;
+  pthread_cond_t work_cond; // Idle workers wait for tasks
+  pthread_cond_t done_cond; // wait_runtime waits for pending == 0
+};
+
+// Initial capacity of a worker deque
+#define DEQUE_INIT_SIZE 64
+
+// Default idle time after which workers release stack pages (see
+// set_runtime_scavenge)
+#ifndef RUNTIME_SCAVENGE_IDLE_NS
+#define RUNTIME_SCAVENGE_IDLE_NS 1000000000ull // 1 s
+#endif // RUNTIME_SCAVENGE_IDLE_NS
+
+// Tasks a busy worker runs between two clock reads
+#define SCAVENGE_CHECK_TASKS 256
+
+// Shortest time between two scavenge passes of a worker
+#define SCAVENGE_MIN_INTERVAL_NS 1000000ull // 1 ms
+
+// Worker running on the calling thread (NULL outside of workers)
+static _Thread_local struct s_worker *tls_worker = NULL;
+
+/* Private Functions */
+
+static struct s_deque_array *deque_array_create(int64_t size) {
+  struct s_deque_array *array =
+      malloc(sizeof(*array) + (size_t)size * sizeof(array->items[0]));
+  assert(array != NULL && "Maybe you should buy more RAM");
+  array->size = size;
+  return array;
+}
+
+static void deque_init(struct s_deque *deque) {
+  atomic_init(&deque->top, 0);
+  atomic_init(&deque->bottom, 0);
+  atomic_init(&deque->array, deque_array_create(DEQUE_INIT_SIZE));
+  da_init(&deque->retired);
+}
+
+static void deque_destroy(struct s_deque *deque) {
+  free(atomic_load_explicit(&deque->array, memory_order_relaxed));
+  for (size_t i = 0; i < deque->retired.count; i++)
+    free(deque->retired.items[i]);
+  da_free(&deque->retired);
+}
+
+/**
+ * @brief Push a task at the bottom of the deque (owner only)
+ */
+static void deque_push(struct s_deque *deque, struct s_task *task) {
+  int64_t b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+  int64_t t = atomic_load_explicit(&deque->top, memory_order_acquire);
+  struct s_deque_array *array =
+      atomic_load_explicit(&deque->array, memory_order_relaxed);
+
+  if (b - t > array->size - 1) {
+    // Full: copy the live range into an array twice as large
+    struct s_deque_array *bigger = deque_array_create(array->size * 2);
+    for (int64_t i = t; i < b; i++) {
+      struct s_task *item = atomic_load_explicit(
+          &array->items[i & (array->size - 1)], memory_order_relaxed);
+      atomic_store_explicit(&bigger->items[i & (bigger->size - 1)], item,
+                            memory_order_relaxed);
+    }
+
+    da_append(&deque->retired, array);
+    atomic_store_explicit(&deque->array, bigger, memory_order_release);
+    array = bigger;
+  }
+
+  atomic_store_explicit(&array->items[b & (array->size - 1)], task,
+                        memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Take the task at the bottom of the deque (owner only)
+ * @return The task, or NULL if the deque is empty
+ */
+static struct s_task *deque_take(struct s_deque *deque) {
+  int64_t b = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+  struct s_deque_array *array =
+      atomic_load_explicit(&deque->array, memory_order_relaxed);
+  atomic_store_explicit(&deque->bottom, b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+  if (t > b) {
+    // Empty
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+    return NULL;
+  }
+
+  struct s_task *task = atomic_load_explicit(
+      &array->items[b & (array->size - 1)], memory_order_relaxed);
+
+  if (t == b) {
+    // Last task: race against thieves for it
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed))
+      task = NULL;
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+  }
+
+  return task;
+}
+
+/**
+ * @brief Steal the task at the top of the deque (any thread)
+ * @return The task, or NULL if the deque is empty or the steal lost a race
+ */
+static struct s_task *deque_steal(struct s_deque *deque) {
+  int64_t t = atomic_load_explicit(&deque->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t b = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+  if (t >= b)
+    return NULL;
+
+  struct s_deque_array *array =
+      atomic_load_explicit(&deque->array, memory_order_acquire);
+  struct s_task *task = atomic_load_explicit(
+      &array->items[t & (array->size - 1)], memory_order_relaxed);
+
+  if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+                                               memory_order_seq_cst,
+                                               memory_order_relaxed))
+    return NULL;
+
+  return task;
+}
+
+static void wake_worker(sp_runtime rt) {
+  if (atomic_load(&rt->sleeping) == 0)
+    return;
+
+  pthread_mutex_lock(&rt->lock);
+  pthread_cond_signal(&rt->work_cond);
+  pthread_mutex_unlock(&rt->lock);
+}
+
+static void inject_task(sp_runtime rt, struct s_task *task) {
+  task->next = NULL;
+
+  pthread_mutex_lock(&rt->inject_lock);
+  if (rt->inject_tail != NULL)
+    rt->inject_tail->next = task;
+  else
+    rt->inject_head = task;
+  rt->inject_tail = task;
+  pthread_mutex_unlock(&rt->inject_lock);
+}
+
+static struct s_task *pop_injected(sp_runtime rt) {
+  pthread_mutex_lock(&rt->inject_lock);
+  struct s_task *task = rt->inject_head;
+  if (task != NULL) {
+    rt->inject_head = task->next;
+    if (rt->inject_head == NULL)
+      rt->inject_tail = NULL;
+  }
+  pthread_mutex_unlock(&rt->inject_lock);
+
+  return task;
+}
+
+/**
+ * @brief Make a task runnable, on the current worker when called from one
+ */
+static void queue_task(sp_runtime rt, struct s_task *task) {
+  // Counted before being published so that the count never underflows
+  atomic_fetch_add(&rt->queued, 1);
+
+  if (tls_worker != NULL && tls_worker->rt == rt)
+    deque_push(&tls_worker->deque, task);
+  else
+    inject_task(rt, task);
+
+  wake_worker(rt);
+}
+
+/**
+ * @brief Find a runnable task: own deque first, then the injection queue,
+ * then steal from the other workers starting at a random victim
+ */
+static struct s_task *find_task(struct s_worker *worker) {
+  sp_runtime rt = worker->rt;
+  struct s_task *task = deque_take(&worker->deque);
+
+  if (task == NULL)
+    task = pop_injected(rt);
+
+  if (task == NULL && rt->worker_count > 1) {
+    // xorshift64
+    worker->seed ^= worker->seed << 13;
+    worker->seed ^= worker->seed >> 7;
+    worker->seed ^= worker->seed << 17;
+
+    size_t start = worker->seed % rt->worker_count;
+    for (size_t i = 0; i < rt->worker_count && task == NULL; i++) {
+      struct s_worker *victim = &rt->workers[(start + i) % rt->worker_count];
+      if (victim != worker)
+        task = deque_steal(&victim->deque);
+    }
+  }
+
+  if (task != NULL)
+    atomic_fetch_sub(&rt->queued, 1);
+
+  return task;
+}
+
+static uint64_t now_ns(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Time between two scavenge passes: half the idle time, so that
+ * pages are released between `idle_ns` and 1.5 * `idle_ns` after last use
+ */
+static uint64_t scavenge_interval(uint64_t idle_ns) {
+  uint64_t interval = idle_ns / 2;
+  return interval < SCAVENGE_MIN_INTERVAL_NS ? SCAVENGE_MIN_INTERVAL_NS
+                                             : interval;
+}
+
+/**
+ * @brief Scavenge the worker stack if a pass is due
+ * @return Time until the next pass is due (0 if scavenging is off)
+ */
+static uint64_t maybe_scavenge(struct s_worker *worker) {
+  uint64_t idle_ns = atomic_load_explicit(&worker->rt->scavenge_idle_ns,
+                                          memory_order_relaxed);
+  if (idle_ns == 0)
+    return 0;
+
+  uint64_t now = now_ns(CLOCK_MONOTONIC);
+  uint64_t interval = scavenge_interval(idle_ns);
+  worker->runs = 0;
+
+  if (now - worker->last_scavenge < interval)
+    return worker->last_scavenge + interval - now;
+
+  size_t released = scavenge_stack(worker->stack, idle_ns);
+  atomic_fetch_add_explicit(&worker->scavenged, released,
+                            memory_order_relaxed);
+  worker->last_scavenge = now;
+  return interval;
+}
+
+/**
+ * @brief Sleep until a task is queued, the runtime stops, or `timeout_ns`
+ * elapsed (0 waits without timeout)
+ */
+static void wait_for_work(sp_runtime rt, uint64_t timeout_ns) {
+  pthread_mutex_lock(&rt->lock);
+  atomic_fetch_add(&rt->sleeping, 1);
+
+  // A single wait: the worker loop re-checks for tasks and scavenging on any
+  // wake-up (set_runtime_scavenge broadcasts to apply a new idle time)
+  if (atomic_load(&rt->queued) == 0 && !atomic_load(&rt->stopping)) {
+    if (timeout_ns == 0) {
+      pthread_cond_wait(&rt->work_cond, &rt->lock);
+    } else {
+      // Condition variables wait on CLOCK_REALTIME by default
+      uint64_t deadline = now_ns(CLOCK_REALTIME) + timeout_ns;
+      struct timespec ts = {(time_t)(deadline / 1000000000ull),
+                            (long)(deadline % 1000000000ull)};
+      pthread_cond_timedwait(&rt->work_cond, &rt->lock, &ts);
+    }
+  }
+
+  atomic_fetch_sub(&rt->sleeping, 1);
+  pthread_mutex_unlock(&rt->lock);
+}
+
+static void task_entry(sp_stack stack, void *arg) {
+  (void)stack; // Stale once the task migrates, see yield_task
+  struct s_task *task = arg;
+  task->fn(task->rt, task->arg);
+}
+
+/**
+ * @brief Run a task on the worker until it yields or finishes
+ */
+static void run_task(struct s_worker *worker, struct s_task *task) {
+  if (task->ctx == NULL)
+    task->ctx = create_ctx(worker->stack, task_entry, task);
+  else
+    register_ctx(worker->stack, task->ctx); // may come from another worker
+
+  switch_ctx(worker->stack, task->ctx);
+
+  if (is_ctx_finished(task->ctx)) {
+    sp_runtime rt = task->rt;
+    destroy_ctx(task->ctx);
+    free(task);
+
+    if (atomic_fetch_sub(&rt->pending, 1) == 1) {
+      pthread_mutex_lock(&rt->lock);
+      pthread_cond_broadcast(&rt->done_cond);
+      pthread_mutex_unlock(&rt->lock);
+    }
+    return;
+  }
+
+  // Yielded: the task is only published once we are off its stack, so a
+  // thief never resumes it while it is still running here
+  unregister_ctx(worker->stack, task->ctx);
+  queue_task(task->rt, task);
+}
+
+static void *worker_main(void *arg) {
+  struct s_worker *worker = arg;
+  sp_runtime rt = worker->rt;
+
+  tls_worker = worker;
+  worker->stack = init_stack(rt->stack_capacity);
+
+  while (!atomic_load(&rt->stopping)) {
+    struct s_task *task = find_task(worker);
+    if (task != NULL) {
+      run_task(worker, task);
+      if (++worker->runs >= SCAVENGE_CHECK_TASKS)
+        maybe_scavenge(worker);
+      continue;
+    }
+
+    // Idle workers wake up for the next scavenge pass of their stack
+    wait_for_work(rt, maybe_scavenge(worker));
+  }
+
+  deinit_stack(worker->stack);
+  tls_worker = NULL;
+
+  return NULL;
+}
+
+/* Public Functions */
+
+sp_runtime init_runtime(size_t workers, size_t stack_capacity) {
+  assert(workers > 0 && "A runtime needs at least one worker");
+
+  sp_runtime rt = malloc(sizeof(*rt));
+  rt->worker_count = workers;
+  rt->stack_capacity = stack_capacity;
+  rt->workers = malloc(workers * sizeof(*rt->workers));
+
+  pthread_mutex_init(&rt->inject_lock, NULL);
+  rt->inject_head = NULL;
+  rt->inject_tail = NULL;
+
+  atomic_init(&rt->queued, 0);
+  atomic_init(&rt->pending, 0);
+  atomic_init(&rt->sleeping, 0);
+  atomic_init(&rt->stopping, false);
+  atomic_init(&rt->scavenge_idle_ns, RUNTIME_SCAVENGE_IDLE_NS);
+
+  pthread_mutex_init(&rt->lock, NULL);
+  pthread_cond_init(&rt->work_cond, NULL);
+  pthread_cond_init(&rt->done_cond, NULL);
+
+  for (size_t i = 0; i < workers; i++) {
+    struct s_worker *worker = &rt->workers[i];
+    worker->rt = rt;
+    worker->id = i;
+    worker->seed = 0x9e3779b97f4a7c15ull * (i + 1);
+    worker->last_scavenge = 0;
+    worker->runs = 0;
+    atomic_init(&worker->scavenged, 0);
+    deque_init(&worker->deque);
+  }
+
+  for (size_t i = 0; i < workers; i++) {
+    int ret = pthread_create(&rt->workers[i].thread, NULL, worker_main,
+                             &rt->workers[i]);
+    assert(ret == 0 && "Failed to start runtime worker");
+    (void)ret;
+  }
+
+  return rt;
+}
+
+void deinit_runtime(sp_runtime rt) {
+  wait_runtime(rt);
+
+  pthread_mutex_lock(&rt->lock);
+  atomic_store(&rt->stopping, true);
+  pthread_cond_broadcast(&rt->work_cond);
+  pthread_mutex_unlock(&rt->lock);
+
+  for (size_t i = 0; i < rt->worker_count; i++) {
+    pthread_join(rt->workers[i].thread, NULL);
+    deque_destroy(&rt->workers[i].deque);
+  }
+
+  pthread_cond_destroy(&rt->done_cond);
+  pthread_cond_destroy(&rt->work_cond);
+  pthread_mutex_destroy(&rt->lock);
+  pthread_mutex_destroy(&rt->inject_lock);
+
+  free(rt->workers);
+  free(rt);
+}
+
+void spawn_task(sp_runtime rt, sp_task_func fn, void *arg) {
+  struct s_task *task = malloc(sizeof(*task));
+  task->fn = fn;
+  task->arg = arg;
+  task->rt = rt;
+  task->ctx = NULL;
+
+  atomic_fetch_add(&rt->pending, 1);
+  queue_task(rt, task);
+}
+
+void yield_task(sp_runtime rt) {
+  struct s_worker *worker = tls_worker;
+  assert(worker != NULL && worker->rt == rt &&
+         "yield_task must be called from a task of this runtime");
+  (void)rt;
+
+  // Back to the worker loop, which requeues us (we may resume on another
+  // worker, so nothing thread-local is read after this point)
+  switch_ctx(worker->stack, NULL);
+}
+
+void wait_runtime(sp_runtime rt) {
+  pthread_mutex_lock(&rt->lock);
+  while (atomic_load(&rt->pending) > 0)
+    pthread_cond_wait(&rt->done_cond, &rt->lock);
+  pthread_mutex_unlock(&rt->lock);
+}
+
+size_t runtime_worker_id(sp_runtime rt) {
+  struct s_worker *worker = tls_worker;
+  assert(worker != NULL && worker->rt == rt &&
+         "runtime_worker_id must be called from a task of this runtime");
+  (void)rt;
+
+  return worker->id;
+}
+
+void set_runtime_scavenge(sp_runtime rt, uint64_t idle_ns) {
+  atomic_store(&rt->scavenge_idle_ns, idle_ns);
+
+  // Sleeping workers pick up the new interval
+  pthread_mutex_lock(&rt->lock);
+  pthread_cond_broadcast(&rt->work_cond);
+  pthread_mutex_unlock(&rt->lock);
+}
+
+size_t runtime_scavenged_bytes(sp_runtime rt) {
+  size_t total = 0;
+  for (size_t i = 0; i < rt->worker_count; i++)
+    total += atomic_load_explicit(&rt->workers[i].scavenged,
+                                  memory_order_relaxed);
+  return total;
+}
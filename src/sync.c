@@ -0,0 +1,259 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "coroutine.h"
+
+/* Private Types */
+
+// Context parked on a mutex, condition variable or semaphore. As for
+// channels, waiters are heap records recycled through a free list of the
+// object rather than variables of the parked coroutine's stack.
+struct s_sync_waiter {
+  sp_ctx ctx;   // Parked context (NULL for main context)
+  bool granted; // Given the mutex or a semaphore unit by the waker
+  struct s_sync_waiter *next;
+};
+
+// FIFO of parked contexts, linked through the waiters themselves
+struct s_sync_queue {
+  struct s_sync_waiter *head;
+  struct s_sync_waiter *tail;
+  struct s_sync_waiter *free_waiters; // Recycled waiters
+};
+
+struct s_mutex {
+  sp_stack stack;
+  bool locked;
+  sp_ctx owner; // Locking context (NULL for main context)
+  struct s_sync_queue waiters;
+};
+
+struct s_cond {
+  sp_stack stack;
+  sp_mutex mutex; // Mutex of the current waiters
+  struct s_sync_queue waiters;
+};
+
+struct s_sem {
+  sp_stack stack;
+  size_t count;
+  struct s_sync_queue waiters;
+};
+
+/* Private Functions */
+
+static void queue_push(struct s_sync_queue *queue,
+                       struct s_sync_waiter *waiter) {
+  waiter->next = NULL;
+  if (queue->tail != NULL)
+    queue->tail->next = waiter;
+  else
+    queue->head = waiter;
+  queue->tail = waiter;
+}
+
+static struct s_sync_waiter *queue_pop(struct s_sync_queue *queue) {
+  struct s_sync_waiter *waiter = queue->head;
+  if (waiter == NULL)
+    return NULL;
+
+  queue->head = waiter->next;
+  if (queue->head == NULL)
+    queue->tail = NULL;
+
+  return waiter;
+}
+
+static void queue_free(struct s_sync_queue *queue) {
+  assert(queue->head == NULL && "Cannot destroy an object with waiters");
+
+  while (queue->free_waiters != NULL) {
+    struct s_sync_waiter *waiter = queue->free_waiters;
+    queue->free_waiters = waiter->next;
+    free(waiter);
+  }
+}
+
+/**
+ * @brief Park the current context in a queue until a waker grants it
+ *
+ * The waiter comes from (and goes back to) the free list of `pool`, which
+ * is not necessarily the queue it is parked in.
+ */
+static void wait_granted(sp_stack stack, struct s_sync_queue *pool,
+                         struct s_sync_queue *queue) {
+  struct s_sync_waiter *waiter = pool->free_waiters;
+  if (waiter != NULL) {
+    pool->free_waiters = waiter->next;
+  } else {
+    waiter = malloc(sizeof(*waiter));
+    assert(waiter != NULL && "Maybe you should buy more RAM");
+  }
+
+  waiter->ctx = get_ctx(stack);
+  waiter->granted = false;
+  queue_push(queue, waiter);
+
+  // Spurious unpark_ctx are ignored
+  while (!waiter->granted)
+    park_ctx(stack);
+
+  waiter->next = pool->free_waiters;
+  pool->free_waiters = waiter;
+}
+
+static void grant(sp_stack stack, struct s_sync_waiter *waiter) {
+  waiter->granted = true;
+  unpark_ctx(stack, waiter->ctx);
+}
+
+/**
+ * @brief Hand a free mutex to a waiter, or queue the waiter behind the owner
+ */
+static void mutex_enqueue(sp_mutex mutex, struct s_sync_waiter *waiter) {
+  if (mutex->locked) {
+    queue_push(&mutex->waiters, waiter);
+    return;
+  }
+
+  mutex->locked = true;
+  mutex->owner = waiter->ctx;
+  grant(mutex->stack, waiter);
+}
+
+/* Public Functions */
+
+sp_mutex mutex_create(sp_stack stack) {
+  sp_mutex mutex = calloc(1, sizeof(*mutex));
+  assert(mutex != NULL && "Maybe you should buy more RAM");
+  mutex->stack = stack;
+  return mutex;
+}
+
+void mutex_destroy(sp_mutex mutex) {
+  assert(!mutex->locked && "Cannot destroy a locked mutex");
+  queue_free(&mutex->waiters);
+  free(mutex);
+}
+
+void mutex_lock(sp_mutex mutex) {
+  if (!mutex->locked) {
+    mutex->locked = true;
+    mutex->owner = get_ctx(mutex->stack);
+    return;
+  }
+
+  assert(mutex->owner != get_ctx(mutex->stack) &&
+         "Mutex is already locked by this context");
+
+  // mutex_unlock hands the mutex over: we own it once granted
+  wait_granted(mutex->stack, &mutex->waiters, &mutex->waiters);
+}
+
+bool mutex_try_lock(sp_mutex mutex) {
+  if (mutex->locked)
+    return false;
+
+  mutex->locked = true;
+  mutex->owner = get_ctx(mutex->stack);
+  return true;
+}
+
+void mutex_unlock(sp_mutex mutex) {
+  assert(mutex->locked && mutex->owner == get_ctx(mutex->stack) &&
+         "Mutex is not locked by this context");
+
+  // Ownership goes straight to the oldest waiter, so a context that unlocks
+  // and locks again in a loop cannot starve it
+  struct s_sync_waiter *waiter = queue_pop(&mutex->waiters);
+  if (waiter == NULL) {
+    mutex->locked = false;
+    return;
+  }
+
+  mutex->owner = waiter->ctx;
+  grant(mutex->stack, waiter);
+}
+
+sp_cond cond_create(sp_stack stack) {
+  sp_cond cond = calloc(1, sizeof(*cond));
+  assert(cond != NULL && "Maybe you should buy more RAM");
+  cond->stack = stack;
+  return cond;
+}
+
+void cond_destroy(sp_cond cond) {
+  queue_free(&cond->waiters);
+  free(cond);
+}
+
+void cond_wait(sp_cond cond, sp_mutex mutex) {
+  assert((cond->waiters.head == NULL || cond->mutex == mutex) &&
+         "All waiters of a condition must use the same mutex");
+  cond->mutex = mutex;
+
+  // mutex_unlock only makes the next owner runnable, so no signal can come
+  // before we are queued. We wake up owning the mutex again (see
+  // cond_signal). The waiter comes from the pool of the mutex, as a signal
+  // moves it to the mutex queue: the condition may be destroyed meanwhile.
+  mutex_unlock(mutex);
+  wait_granted(cond->stack, &mutex->waiters, &cond->waiters);
+}
+
+void cond_signal(sp_cond cond) {
+  struct s_sync_waiter *waiter = queue_pop(&cond->waiters);
+  if (waiter != NULL)
+    mutex_enqueue(cond->mutex, waiter);
+}
+
+void cond_broadcast(sp_cond cond) {
+  // Waiters move to the mutex queue in order instead of all waking up to
+  // fight over it
+  struct s_sync_waiter *waiter;
+  while ((waiter = queue_pop(&cond->waiters)) != NULL)
+    mutex_enqueue(cond->mutex, waiter);
+}
+
+sp_sem sema_create(sp_stack stack, size_t count) {
+  sp_sem sem = calloc(1, sizeof(*sem));
+  assert(sem != NULL && "Maybe you should buy more RAM");
+  sem->stack = stack;
+  sem->count = count;
+  return sem;
+}
+
+void sema_destroy(sp_sem sem) {
+  queue_free(&sem->waiters);
+  free(sem);
+}
+
+void sema_acquire(sp_sem sem) {
+  if (sem->count > 0) {
+    sem->count--;
+    return;
+  }
+
+  // sema_release hands its unit over instead of incrementing the count
+  wait_granted(sem->stack, &sem->waiters, &sem->waiters);
+}
+
+bool sema_try_acquire(sp_sem sem) {
+  if (sem->count == 0)
+    return false;
+
+  sem->count--;
+  return true;
+}
+
+void sema_release(sp_sem sem) {
+  struct s_sync_waiter *waiter = queue_pop(&sem->waiters);
+  if (waiter == NULL) {
+    sem->count++;
+    return;
+  }
+
+  grant(sem->stack, waiter);
+}
+
+size_t sema_count(sp_sem sem) { return sem->count; }
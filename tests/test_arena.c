@@ -0,0 +1,144 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "coroutine.h"
+
+#define ASSERT_TRUE(cond, msg)                                                \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      fprintf(stderr, "FAIL: %s:%d: %s\n", __FILE__, __LINE__, (msg));        \
+      return 1;                                                               \
+    }                                                                         \
+  } while (0)
+
+// Upper bound on the number of coroutines spawned by this test
+#define MAX_COROUTINES 300000
+// Coroutines of the guarded arena check
+#define GUARDED 1000
+
+static size_t read_max_map_count(void) {
+  size_t value = 65530; // Linux default
+
+  FILE *f = fopen("/proc/sys/vm/max_map_count", "r");
+  if (f != NULL) {
+    if (fscanf(f, "%zu", &value) != 1)
+      value = 65530;
+    fclose(f);
+  }
+
+  return value;
+}
+
+// Number of mappings of the process
+static size_t count_mappings(void) {
+  size_t lines = 0;
+
+  FILE *f = fopen("/proc/self/maps", "r");
+  if (f == NULL)
+    return 0;
+  for (int c; (c = fgetc(f)) != EOF;)
+    lines += c == '\n';
+  fclose(f);
+
+  return lines;
+}
+
+static void sleeper(sp_stack stack, void *arg) {
+  int *alive = arg;
+  (*alive)++;
+  yield_ctx(stack); // stay suspended until main resumes us
+  (*alive)--;
+}
+
+// Guard pages split the arena reservation: each guarded stack costs extra
+// mappings (see SP_STACK_GUARD), which go away with the stacks
+static int run_guarded(void) {
+  sp_stack stack =
+      init_stack_ex(4 * getpagesize(), SP_STACK_ARENA | SP_STACK_GUARD);
+  sp_ctx ctxs[GUARDED];
+  int alive = 0;
+
+  // The first stack maps the reservation itself
+  sp_ctx first = create_ctx(stack, sleeper, &alive);
+  size_t before = count_mappings();
+  for (size_t i = 0; i < GUARDED; i++)
+    ctxs[i] = create_ctx(stack, sleeper, &alive);
+  size_t during = count_mappings();
+
+  yield_ctx(stack);
+  ASSERT_TRUE(alive == GUARDED + 1, "guarded coroutines should run");
+  while (alive > 0)
+    yield_ctx(stack);
+
+  destroy_ctx(first);
+  for (size_t i = 0; i < GUARDED; i++)
+    destroy_ctx(ctxs[i]);
+  trim_pool(stack, 0);
+  size_t after = count_mappings();
+
+  if (before > 0) {
+    ASSERT_TRUE(during - before >= GUARDED && during - before <= 2 * GUARDED,
+                "each guarded stack should cost one or two mappings");
+    ASSERT_TRUE(after <= before,
+                "released slots should merge back into the reservation");
+  }
+
+  stack_t ss;
+  ASSERT_TRUE(sigaltstack(NULL, &ss) == 0 && !(ss.ss_flags & SS_DISABLE),
+              "guarded stack should install an alternate signal stack");
+  deinit_stack(stack);
+  ASSERT_TRUE(sigaltstack(NULL, &ss) == 0 && (ss.ss_flags & SS_DISABLE),
+              "alternate signal stack should go with the last guarded stack");
+  return 0;
+}
+
+int main(void) {
+  if (run_guarded() != 0)
+    return 1;
+
+  // One mapping per coroutine would exceed the map limit with this many
+  size_t count = read_max_map_count() + 1024;
+  if (count > MAX_COROUTINES) {
+    printf("max_map_count is large, capping at %d coroutines\n",
+           MAX_COROUTINES);
+    count = MAX_COROUTINES;
+  }
+
+  sp_stack stack = init_stack_ex(4 * getpagesize(), SP_STACK_ARENA);
+  sp_ctx *ctxs = malloc(count * sizeof(*ctxs));
+  int alive = 0;
+
+  for (size_t i = 0; i < count; i++)
+    ctxs[i] = create_ctx(stack, sleeper, &alive);
+
+  // Every coroutine runs once and suspends
+  yield_ctx(stack);
+  ASSERT_TRUE((size_t)alive == count, "all coroutines should be suspended");
+
+  int finished = 0;
+  while (!finished) {
+    yield_ctx(stack);
+    finished = 1;
+    for (size_t i = 0; i < count && finished; i++)
+      finished = is_ctx_finished(ctxs[i]);
+  }
+  ASSERT_TRUE(alive == 0, "all coroutines should have finished");
+
+  for (size_t i = 0; i < count; i++)
+    destroy_ctx(ctxs[i]);
+
+  // Slots released to the arena are handed out again
+  sp_ctx again = create_ctx(stack, sleeper, &alive);
+  switch_ctx(stack, again);
+  yield_ctx(stack);
+  ASSERT_TRUE(is_ctx_finished(again), "recycled slot should run to the end");
+  destroy_ctx(again);
+
+  free(ctxs);
+  deinit_stack(stack);
+
+  printf("test_arena passed (%zu coroutines)\n", count);
+  return 0;
+}
@@ -0,0 +1,142 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "coroutine.h"
+
+#define ASSERT_TRUE(cond, msg)                                                \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      fprintf(stderr, "FAIL: %s:%d: %s\n", __FILE__, __LINE__, (msg));        \
+      return 1;                                                               \
+    }                                                                         \
+  } while (0)
+
+#define STEPS 100
+#define WAITERS 8
+
+struct work {
+  int steps;
+  int runs;
+};
+
+// Yields `steps` times, then returns steps * 2
+static void worker(sp_stack stack, void *arg) {
+  struct work *w = arg;
+  for (int i = 0; i < w->steps; i++) {
+    w->runs++;
+    yield_ctx(stack);
+  }
+  set_ctx_result(stack, (void *)(uintptr_t)(w->steps * 2));
+}
+
+struct waiter {
+  sp_ctx target;
+  void *result;
+  int resumes;
+};
+
+static void wait_for(sp_stack stack, void *arg) {
+  struct waiter *w = arg;
+  w->result = await_ctx(stack, w->target);
+  w->resumes++;
+}
+
+static void no_result(sp_stack stack, void *arg) {
+  (void)stack;
+  (void)arg;
+}
+
+// Awaits a child coroutine and forwards its result plus one
+static void parent(sp_stack stack, void *arg) {
+  struct work *child_work = arg;
+  sp_ctx child = create_ctx(stack, worker, child_work);
+  uintptr_t child_result = (uintptr_t)await_ctx(stack, child);
+  destroy_ctx(child);
+  set_ctx_result(stack, (void *)(child_result + 1));
+}
+
+struct counter {
+  int ticks;
+};
+
+static void spin(sp_stack stack, void *arg) {
+  struct counter *c = arg;
+  for (int i = 0; i < STEPS; i++) {
+    c->ticks++;
+    yield_ctx(stack);
+  }
+}
+
+int main(void) {
+  sp_stack stack = init_stack(0);
+
+  // Main waits without polling
+  struct work w = {.steps = STEPS};
+  sp_ctx ctx = create_ctx(stack, worker, &w);
+  void *result = await_ctx(stack, ctx);
+  ASSERT_TRUE(w.runs == STEPS, "worker should run to completion");
+  ASSERT_TRUE(is_ctx_finished(ctx), "worker should be finished");
+  ASSERT_TRUE(result == (void *)(2 * STEPS), "await should return the result");
+  ASSERT_TRUE(get_ctx_result(ctx) == result, "result should stay readable");
+
+  // Awaiting a finished context returns right away
+  ASSERT_TRUE(await_ctx(stack, ctx) == result, "second await should return");
+  destroy_ctx(ctx);
+
+  // Several waiters get the same result, exactly once each
+  w = (struct work){.steps = STEPS};
+  sp_ctx target = create_ctx(stack, worker, &w);
+  struct waiter waiters[WAITERS] = {0};
+  sp_ctx waiter_ctxs[WAITERS];
+  for (int i = 0; i < WAITERS; i++) {
+    waiters[i].target = target;
+    waiter_ctxs[i] = create_ctx(stack, wait_for, &waiters[i]);
+  }
+
+  // The target finishes while main awaits another coroutine
+  struct counter c = {0};
+  sp_ctx ticker = create_ctx(stack, spin, &c);
+  await_ctx(stack, ticker);
+  destroy_ctx(ticker);
+  ASSERT_TRUE(c.ticks == STEPS, "ticker should run to completion");
+  ASSERT_TRUE(w.runs == STEPS, "target should have finished meanwhile");
+
+  for (int i = 0; i < WAITERS; i++) {
+    await_ctx(stack, waiter_ctxs[i]);
+    ASSERT_TRUE(waiters[i].result == (void *)(2 * STEPS),
+                "every waiter should get the result");
+    ASSERT_TRUE(waiters[i].resumes == 1, "waiter should resume once");
+    destroy_ctx(waiter_ctxs[i]);
+  }
+  destroy_ctx(target);
+
+  // Coroutines can await their own children
+  struct work child_work = {.steps = STEPS};
+  ctx = create_ctx(stack, parent, &child_work);
+  ASSERT_TRUE(await_ctx(stack, ctx) == (void *)(2 * STEPS + 1),
+              "parent should forward the child result");
+  destroy_ctx(ctx);
+
+  // Results default to NULL, even when the context is recycled
+  ctx = create_ctx(stack, no_result, NULL);
+  ASSERT_TRUE(await_ctx(stack, ctx) == NULL, "result should default to NULL");
+  destroy_ctx(ctx);
+
+  // Spurious wake-ups do not end the wait early
+  w = (struct work){.steps = STEPS};
+  target = create_ctx(stack, worker, &w);
+  struct waiter early = {.target = target};
+  sp_ctx early_ctx = create_ctx(stack, wait_for, &early);
+  yield_ctx(stack); // the waiter parks
+  unpark_ctx(stack, early_ctx);
+  await_ctx(stack, early_ctx);
+  ASSERT_TRUE(early.result == (void *)(2 * STEPS) && w.runs == STEPS,
+              "spuriously woken waiter should keep waiting");
+  destroy_ctx(early_ctx);
+  destroy_ctx(target);
+
+  deinit_stack(stack);
+
+  printf("test_await passed\n");
+  return 0;
+}
@@ -0,0 +1,180 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "coroutine.h"
+
+#define ASSERT_TRUE(cond, msg)                                                \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      fprintf(stderr, "FAIL: %s:%d: %s\n", __FILE__, __LINE__, (msg));        \
+      return 1;                                                               \
+    }                                                                         \
+  } while (0)
+
+#define MESSAGES 1000
+#define PRODUCERS 4
+
+struct link {
+  sp_chan chan;
+  uintptr_t first;
+  uintptr_t count;
+  uintptr_t sum;
+  uintptr_t last; // Last value received when it was handed over
+  bool in_order;
+};
+
+static void produce(sp_stack stack, void *arg) {
+  (void)stack;
+  struct link *l = arg;
+  for (uintptr_t i = 0; i < l->count; i++)
+    chan_send(l->chan, (void *)(l->first + i));
+}
+
+static void consume(sp_stack stack, void *arg) {
+  (void)stack;
+  struct link *l = arg;
+  void *value;
+  uintptr_t expected = l->first;
+
+  l->in_order = true;
+  while (chan_recv(l->chan, &value)) {
+    l->in_order &= (uintptr_t)value == expected++;
+    l->sum += (uintptr_t)value;
+    l->last = (uintptr_t)value;
+  }
+}
+
+static int run_fifo(unsigned flags, size_t capacity) {
+  sp_stack stack = init_stack_ex(0, flags);
+  struct link l = {.chan = chan_create(stack, capacity), .first = 1,
+                   .count = MESSAGES};
+
+  sp_ctx consumer = create_ctx(stack, consume, &l);
+  sp_ctx producer = create_ctx(stack, produce, &l);
+  await_ctx(stack, producer);
+  chan_close(l.chan);
+  await_ctx(stack, consumer);
+
+  ASSERT_TRUE(l.in_order, "values should be received in order");
+  ASSERT_TRUE(l.sum == MESSAGES * (MESSAGES + 1) / 2,
+              "every value should be received once");
+
+  destroy_ctx(producer);
+  destroy_ctx(consumer);
+  chan_destroy(l.chan);
+  deinit_stack(stack);
+  return 0;
+}
+
+static int run_many_to_one(unsigned flags) {
+  sp_stack stack = init_stack_ex(0, flags);
+  sp_chan chan = chan_create(stack, 8);
+  struct link producers[PRODUCERS];
+  sp_ctx ctxs[PRODUCERS];
+
+  for (size_t i = 0; i < PRODUCERS; i++) {
+    producers[i] = (struct link){.chan = chan, .first = 1 + i * MESSAGES,
+                                 .count = MESSAGES};
+    ctxs[i] = create_ctx(stack, produce, &producers[i]);
+  }
+
+  // Main receives: it parks like any coroutine
+  uintptr_t sum = 0;
+  void *value;
+  for (size_t i = 0; i < PRODUCERS * MESSAGES; i++) {
+    ASSERT_TRUE(chan_recv(chan, &value), "channel should stay open");
+    sum += (uintptr_t)value;
+  }
+
+  size_t n = PRODUCERS * MESSAGES;
+  ASSERT_TRUE(sum == n * (n + 1) / 2, "every value should be received once");
+
+  for (size_t i = 0; i < PRODUCERS; i++) {
+    await_ctx(stack, ctxs[i]);
+    destroy_ctx(ctxs[i]);
+  }
+  chan_destroy(chan);
+  deinit_stack(stack);
+  return 0;
+}
+
+static void recv_one(sp_stack stack, void *arg) {
+  (void)stack;
+  struct link *l = arg;
+  void *value;
+  if (chan_recv(l->chan, &value))
+    l->last = (uintptr_t)value;
+}
+
+static void send_one(sp_stack stack, void *arg) {
+  (void)stack;
+  struct link *l = arg;
+  l->in_order = chan_send(l->chan, (void *)1);
+}
+
+static int run_handoff_and_close(unsigned flags) {
+  sp_stack stack = init_stack_ex(0, flags);
+  struct link l = {.chan = chan_create(stack, 4)};
+
+  // A send to a parked receiver runs the receiver before returning
+  sp_ctx receiver = create_ctx(stack, recv_one, &l);
+  yield_ctx(stack);
+  ASSERT_TRUE(chan_send(l.chan, (void *)42), "send should succeed");
+  ASSERT_TRUE(l.last == 42, "receiver should run before send returns");
+  ASSERT_TRUE(chan_len(l.chan) == 0, "handoff should bypass the buffer");
+  await_ctx(stack, receiver);
+  destroy_ctx(receiver);
+
+  // Closing keeps buffered values and fails parked senders
+  for (uintptr_t i = 1; i <= 4; i++)
+    ASSERT_TRUE(chan_send(l.chan, (void *)i), "buffered send should succeed");
+  l.in_order = true;
+  sp_ctx sender = create_ctx(stack, send_one, &l);
+  yield_ctx(stack);
+  chan_close(l.chan);
+  await_ctx(stack, sender);
+  ASSERT_TRUE(!l.in_order, "parked sender should fail on close");
+  ASSERT_TRUE(!chan_send(l.chan, (void *)5), "send after close should fail");
+  ASSERT_TRUE(is_chan_closed(l.chan), "channel should be closed");
+
+  void *value;
+  for (uintptr_t i = 1; i <= 4; i++) {
+    ASSERT_TRUE(chan_recv(l.chan, &value) && (uintptr_t)value == i,
+                "buffered values should survive close");
+  }
+  ASSERT_TRUE(!chan_recv(l.chan, &value) && value == NULL,
+              "drained closed channel should fail");
+  destroy_ctx(sender);
+  chan_destroy(l.chan);
+
+  // Unbounded channels never park senders
+  sp_chan unbounded = chan_create(stack, SP_CHAN_UNBOUNDED);
+  for (uintptr_t i = 0; i < MESSAGES; i++)
+    chan_send(unbounded, (void *)i);
+  ASSERT_TRUE(chan_len(unbounded) == MESSAGES, "all values should be buffered");
+  for (uintptr_t i = 0; i < MESSAGES; i++)
+    ASSERT_TRUE(chan_recv(unbounded, &value) && (uintptr_t)value == i,
+                "values should come out in order");
+  chan_destroy(unbounded);
+
+  deinit_stack(stack);
+  return 0;
+}
+
+int main(void) {
+  unsigned modes[] = {0, SP_STACK_SHARED};
+
+  for (size_t i = 0; i < 2; i++) {
+    if (run_fifo(modes[i], 0) != 0 || run_fifo(modes[i], 1) != 0 ||
+        run_fifo(modes[i], 64) != 0 ||
+        run_fifo(modes[i], SP_CHAN_UNBOUNDED) != 0)
+      return 1;
+    if (run_many_to_one(modes[i]) != 0)
+      return 1;
+    if (run_handoff_and_close(modes[i]) != 0)
+      return 1;
+  }
+
+  printf("test_channel passed\n");
+  return 0;
+}
@@ -72,11 +72,43 @@ static int test_switch_direct(void) {
   return 0;
 }
 
+static int test_pool_reuse(void) {
+  sp_stack stack = init_stack(0);
+  struct call_counter counter = {0};
+
+  sp_ctx first = create_ctx(stack, one_shot, &counter);
+  switch_ctx(stack, first);
+  destroy_ctx(first);
+
+  // The destroyed context (and its stack) is handed back by create_ctx
+  sp_ctx second = create_ctx(stack, one_shot, &counter);
+  ASSERT_TRUE(second == first, "create_ctx should reuse the pooled context");
+  ASSERT_TRUE(!is_ctx_finished(second), "reused ctx should not be finished");
+
+  switch_ctx(stack, second);
+  ASSERT_EQ_INT(counter.called, 2, "reused ctx should run its new function");
+  destroy_ctx(second);
+
+  ASSERT_EQ_INT((int)trim_pool(stack, 0), 1, "trim should release one ctx");
+  ASSERT_EQ_INT((int)trim_pool(stack, 0), 0, "pool should now be empty");
+
+  // With a zero high watermark nothing is kept around
+  set_pool_watermarks(stack, 0, 0);
+  sp_ctx third = create_ctx(stack, one_shot, &counter);
+  switch_ctx(stack, third);
+  destroy_ctx(third);
+  ASSERT_EQ_INT((int)trim_pool(stack, 0), 0, "pool should stay empty");
+
+  deinit_stack(stack);
+  return 0;
+}
+
 int main(void) {
   int failures = 0;
 
   failures += test_yield_round_robin();
   failures += test_switch_direct();
+  failures += test_pool_reuse();
 
   if (failures == 0) {
     printf("All tests passed\n");
@@ -0,0 +1,148 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "coroutine.h"
+
+#define ASSERT_TRUE(cond, msg)                                                \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      fprintf(stderr, "FAIL: %s:%d: %s\n", __FILE__, __LINE__, (msg));        \
+      return 1;                                                               \
+    }                                                                         \
+  } while (0)
+
+#define SMALL_STACK (16 * 1024)
+#define LARGE_STACK (1024 * 1024)
+#define SMALL_COUNT 64
+#define USER_STACK (64 * 1024)
+
+// Fills `depth` bytes of its stack, then yields once with them live
+static void use_stack(sp_stack stack, void *arg) {
+  size_t depth = (size_t)(uintptr_t)arg;
+  volatile unsigned char frame[depth];
+
+  memset((unsigned char *)frame, 0xa5, depth);
+  yield_ctx(stack);
+  set_ctx_result(stack, (void *)(uintptr_t)frame[depth - 1]);
+}
+
+// printf of a double uses SSE, which faults on a misaligned stack
+static void format(sp_stack stack, void *arg) {
+  (void)stack;
+  snprintf(arg, 32, "%.2f", 2.5);
+}
+
+struct where {
+  uintptr_t local;
+};
+
+static void locate(sp_stack stack, void *arg) {
+  (void)stack;
+  struct where *w = arg;
+  int local = 0;
+  w->local = (uintptr_t)&local;
+}
+
+static int run(unsigned flags) {
+  sp_stack stack = init_stack_ex(64 * 1024, flags);
+
+  // Small and large coroutines side by side on one stack
+  sp_ctx_attr small = {.stack_size = SMALL_STACK, .name = "small"};
+  sp_ctx_attr large = {.stack_size = LARGE_STACK, .name = "large"};
+  sp_ctx ctxs[SMALL_COUNT];
+
+  sp_ctx big = create_ctx_ex(stack, use_stack, (void *)(uintptr_t)(512 * 1024),
+                             &large);
+  for (size_t i = 0; i < SMALL_COUNT; i++)
+    ctxs[i] = create_ctx_ex(stack, use_stack, (void *)(uintptr_t)(4 * 1024),
+                            &small);
+
+  ASSERT_TRUE(strcmp(get_ctx_name(big), "large") == 0,
+              "large context should keep its name");
+  ASSERT_TRUE(get_ctx_name(get_ctx(stack)) == NULL,
+              "main context should have no name");
+
+  ASSERT_TRUE(await_ctx(stack, big) == (void *)(uintptr_t)0xa5,
+              "large context should use half a megabyte of stack");
+  for (size_t i = 0; i < SMALL_COUNT; i++)
+    ASSERT_TRUE(await_ctx(stack, ctxs[i]) == (void *)(uintptr_t)0xa5,
+                "small contexts should run");
+
+  destroy_ctx(big);
+  for (size_t i = 0; i < SMALL_COUNT; i++)
+    destroy_ctx(ctxs[i]);
+  ASSERT_TRUE(trim_pool(stack, 0) == 0,
+              "contexts with their own stack size should not be pooled");
+
+  // Default attributes go through the pool like create_ctx
+  sp_ctx_attr defaults = {.name = "default"};
+  sp_ctx plain = create_ctx_ex(stack, use_stack, (void *)(uintptr_t)64,
+                               &defaults);
+  await_ctx(stack, plain);
+  destroy_ctx(plain);
+  ASSERT_TRUE(trim_pool(stack, 0) == 1,
+              "contexts with the default stack should be pooled");
+
+  // Guard page choice against the stack default, with a pre-faulted stack
+  sp_ctx_attr guarded = {.guard = SP_GUARD_ON, .prefault = 8 * 1024};
+  sp_ctx_attr unguarded = {.guard = SP_GUARD_OFF, .prefault = 1 << 30};
+  sp_ctx on = create_ctx_ex(stack, use_stack, (void *)(uintptr_t)1024,
+                            &guarded);
+  sp_ctx off = create_ctx_ex(stack, use_stack, (void *)(uintptr_t)1024,
+                             &unguarded);
+  await_ctx(stack, on);
+  await_ctx(stack, off);
+  destroy_ctx(on);
+  destroy_ctx(off);
+
+  // Sizes that are not a multiple of 16 still give aligned stacks
+  size_t odd_sizes[] = {64 * 1024 + 1, 64 * 1024 + 8};
+  for (size_t i = 0; i < 2; i++) {
+    char text[32] = {0};
+    sp_ctx_attr odd = {.stack_size = odd_sizes[i]};
+    sp_ctx ctx = create_ctx_ex(stack, format, text, &odd);
+    await_ctx(stack, ctx);
+    destroy_ctx(ctx);
+    ASSERT_TRUE(strcmp(text, "2.50") == 0,
+                "odd-sized stack should run SSE code");
+  }
+
+  // Caller-owned stack memory is used as is and left to the caller
+  char *memory = malloc(USER_STACK);
+  struct where w = {0};
+  sp_ctx_attr user = {.stack_size = USER_STACK, .stack = memory};
+  sp_ctx local = create_ctx_ex(stack, locate, &w, &user);
+  await_ctx(stack, local);
+  destroy_ctx(local);
+
+  ASSERT_TRUE(w.local >= (uintptr_t)memory &&
+                  w.local < (uintptr_t)memory + USER_STACK,
+              "coroutine should run on the user stack memory");
+  memory[0] = 1; // Still owned by the caller
+  free(memory);
+
+  // NULL attributes behave like create_ctx
+  local = create_ctx_ex(stack, locate, &w, NULL);
+  ASSERT_TRUE(get_ctx_name(local) == NULL, "context should have no name");
+  await_ctx(stack, local);
+  destroy_ctx(local);
+
+  deinit_stack(stack);
+  return 0;
+}
+
+int main(void) {
+  if (run(0) != 0)
+    return 1;
+  if (run(SP_STACK_GUARD) != 0)
+    return 1;
+  if (run(SP_STACK_LAZY) != 0)
+    return 1;
+  if (run(SP_STACK_ARENA) != 0)
+    return 1;
+
+  printf("test_ctx_attr passed\n");
+  return 0;
+}
@@ -0,0 +1,81 @@
+#include <stdio.h>
+
+#include "coroutine.h"
+
+#define ASSERT_TRUE(cond, msg)                                                \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      fprintf(stderr, "FAIL: %s:%d: %s\n", __FILE__, __LINE__, (msg));        \
+      return 1;                                                               \
+    }                                                                         \
+  } while (0)
+
+#define BATCH 64
+#define TOTAL 1000000
+
+static void count(sp_stack stack, void *arg) {
+  int *counter = arg;
+  (*counter)++;
+  yield_ctx(stack);
+  (*counter)++;
+}
+
+static void detach_self(sp_stack stack, void *arg) {
+  sp_ctx *self = arg;
+  *self = get_ctx(stack);
+  detach_ctx(*self);
+  yield_ctx(stack);
+}
+
+static void noop(sp_stack stack, void *arg) {
+  (void)stack;
+  (void)arg;
+}
+
+int main(void) {
+  sp_stack stack = init_stack(64 * 1024);
+  set_pool_watermarks(stack, BATCH, BATCH);
+
+  // Detached contexts go back to the pool once the stack switched off them
+  int counter = 0;
+  for (int i = 0; i < BATCH; i++)
+    detach_ctx(create_ctx(stack, count, &counter));
+  while (counter < 2 * BATCH)
+    yield_ctx(stack);
+  yield_ctx(stack); // scheduler entry after the last finish
+  ASSERT_TRUE(trim_pool(stack, 0) == BATCH, "every context should be pooled");
+
+  // A coroutine can detach itself, and is recycled by the next create_ctx
+  sp_ctx self = NULL;
+  sp_ctx ctx = create_ctx(stack, detach_self, &self);
+  yield_ctx(stack);
+  ASSERT_TRUE(self == ctx, "coroutine should see its own context");
+  yield_ctx(stack); // finishes
+  ASSERT_TRUE(create_ctx(stack, noop, NULL) == ctx,
+              "finished detached context should be reused first");
+
+  // Detaching a finished context destroys it right away
+  yield_ctx(stack);
+  ASSERT_TRUE(is_ctx_finished(ctx), "noop should be finished");
+  trim_pool(stack, 0);
+  detach_ctx(ctx);
+  ASSERT_TRUE(trim_pool(stack, 0) == 1, "noop should be pooled");
+
+  // Fire-and-forget storm: memory stays bounded by the batch size
+  set_pool_watermarks(stack, 16, 64);
+  counter = 0;
+  for (int spawned = 0; spawned < TOTAL; spawned += BATCH) {
+    for (int i = 0; i < BATCH; i++)
+      detach_ctx(create_ctx(stack, count, &counter));
+    yield_ctx(stack);
+    yield_ctx(stack);
+  }
+  yield_ctx(stack);
+  ASSERT_TRUE(counter == 2 * TOTAL, "every detached coroutine should finish");
+  ASSERT_TRUE(trim_pool(stack, 0) <= 64, "pool should stay under its mark");
+
+  deinit_stack(stack);
+
+  printf("test_detach passed\n");
+  return 0;
+}
@@ -0,0 +1,177 @@
+#include <stdio.h>
+
+#include "coroutine.h"
+
+#define ASSERT_TRUE(cond, msg)                                                \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      fprintf(stderr, "FAIL: %s:%d: %s\n", __FILE__, __LINE__, (msg));        \
+      return 1;                                                               \
+    }                                                                         \
+  } while (0)
+
+#define COUNT 1000
+#define GENERATORS 10000
+
+// Yields 0..limit-1 by pointer to a local of the generator
+static void range(sp_gen gen, void *arg) {
+  int limit = *(int *)arg;
+  for (int i = 0; i < limit; i++)
+    gen_yield(gen, &i);
+}
+
+struct filter {
+  sp_stack stack;
+  int limit;
+};
+
+// Pulls from a nested generator and only yields the even values
+static void evens(sp_gen gen, void *arg) {
+  struct filter *f = arg;
+  sp_gen inner = gen_create(f->stack, range, &f->limit);
+
+  int *value;
+  while ((value = gen_next(inner)) != NULL) {
+    if (*value % 2 == 0)
+      gen_yield(gen, value);
+  }
+
+  gen_destroy(inner);
+}
+
+struct consumer {
+  int sum;
+  int ticks;
+};
+
+// Wakes its consumer up (main) before every value
+static void noisy(sp_gen gen, void *arg) {
+  sp_stack stack = arg;
+  for (int i = 0; i < 3; i++) {
+    unpark_ctx(stack, NULL);
+    yield_ctx(stack);
+    gen_yield(gen, &i);
+  }
+}
+
+// Yields forever
+static void counter(sp_gen gen, void *arg) {
+  (void)arg;
+  for (int i = 0;; i++)
+    gen_yield(gen, &i);
+}
+
+// Consumes a generator from a coroutine while another one keeps yielding
+static void consume(sp_stack stack, void *arg) {
+  struct consumer *c = arg;
+  int limit = COUNT;
+  sp_gen gen = gen_create(stack, range, &limit);
+
+  int *value;
+  while ((value = gen_next(gen)) != NULL) {
+    c->sum += *value;
+    yield_ctx(stack);
+  }
+
+  gen_destroy(gen);
+}
+
+static void ticker(sp_stack stack, void *arg) {
+  struct consumer *c = arg;
+  for (int i = 0; i < COUNT; i++) {
+    c->ticks++;
+    yield_ctx(stack);
+  }
+}
+
+// Consumers that are coroutines of the generator stack (values point into
+// the generator stack, which they cannot read with SP_STACK_SHARED)
+static int run_nested(sp_stack stack) {
+  // Generators can consume generators
+  struct filter f = {.stack = stack, .limit = COUNT};
+  sp_gen gen = gen_create(stack, evens, &f);
+  int expected = 0;
+  int *value;
+  while ((value = gen_next(gen)) != NULL) {
+    ASSERT_TRUE(*value == expected, "filtered values should be even");
+    expected += 2;
+  }
+  ASSERT_TRUE(expected == COUNT, "every even value should be produced");
+  gen_destroy(gen);
+
+  // A consumer coroutine interleaves with the other runnable contexts
+  struct consumer c = {0};
+  sp_ctx consumer = create_ctx(stack, consume, &c);
+  sp_ctx tick = create_ctx(stack, ticker, &c);
+  while (!is_ctx_finished(consumer) || !is_ctx_finished(tick))
+    yield_ctx(stack);
+  ASSERT_TRUE(c.sum == COUNT * (COUNT - 1) / 2, "consumer sum mismatch");
+  ASSERT_TRUE(c.ticks == COUNT, "ticker should run alongside the consumer");
+  destroy_ctx(consumer);
+  destroy_ctx(tick);
+
+  return 0;
+}
+
+static int run(unsigned flags) {
+  sp_stack stack = init_stack_ex(0, flags);
+
+  // Values come in order and the end is reported once
+  int limit = COUNT;
+  sp_gen gen = gen_create(stack, range, &limit);
+  yield_ctx(stack);
+  ASSERT_TRUE(!is_gen_finished(gen), "generator should not run on yield");
+
+  int expected = 0;
+  int *value;
+  while ((value = gen_next(gen)) != NULL)
+    ASSERT_TRUE(*value == expected++, "values should come in order");
+  ASSERT_TRUE(expected == COUNT, "every value should be produced");
+  ASSERT_TRUE(is_gen_finished(gen), "generator should be finished");
+  ASSERT_TRUE(gen_next(gen) == NULL, "finished generator should stay empty");
+  gen_destroy(gen);
+
+  // A stray wakeup of the consumer is not mistaken for the end
+  gen = gen_create(stack, noisy, stack);
+  expected = 0;
+  while (gen_next(gen) != NULL)
+    expected++;
+  ASSERT_TRUE(expected == 3, "spurious unpark should not end the iteration");
+  gen_destroy(gen);
+
+  // Consumers may stop early, or before the first value
+  for (int i = 0; i < GENERATORS; i++) {
+    gen = gen_create(stack, counter, NULL);
+    for (int j = 0; j < i % 3; j++)
+      ASSERT_TRUE(*(int *)gen_next(gen) == j, "values should come in order");
+    gen_destroy(gen);
+  }
+  ASSERT_TRUE(get_ctx(stack) == NULL, "main should keep running");
+
+  if (!(flags & SP_STACK_SHARED) && run_nested(stack) != 0)
+    return 1;
+
+  // Finished generators recycle their stacks
+  for (int i = 0; i < GENERATORS; i++) {
+    limit = 1;
+    gen = gen_create(stack, range, &limit);
+    while (gen_next(gen) != NULL)
+      ;
+    gen_destroy(gen);
+  }
+
+  deinit_stack(stack);
+  return 0;
+}
+
+int main(void) {
+  if (run(0) != 0)
+    return 1;
+  if (run(SP_STACK_SHARED) != 0)
+    return 1;
+  if (run(SP_STACK_LAZY) != 0)
+    return 1;
+
+  printf("test_generator passed\n");
+  return 0;
+}
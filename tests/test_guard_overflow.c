@@ -0,0 +1,103 @@
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "coroutine.h"
+
+#define ASSERT_TRUE(cond, msg)                                                \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      fprintf(stderr, "FAIL: %s:%d: %s\n", __FILE__, __LINE__, (msg));        \
+      return 1;                                                               \
+    }                                                                         \
+  } while (0)
+
+// A child process runs a recursion into the guard region of its 16 KiB
+// stack. It must die from the fault after reporting the overflowing context
+// and its function on stderr, instead of silently corrupting a neighbouring
+// mapping (or crashing in the handler).
+
+static int recurse(volatile char *prev, int depth) {
+  volatile char frame[512];
+  if (depth > (1 << 20))
+    return 0; // Far beyond the stack capacity
+
+  frame[0] = (char)depth;
+  frame[sizeof(frame) - 1] = prev != NULL ? prev[0] : 0;
+  return recurse(frame, depth + 1) + frame[0];
+}
+
+static void overflow(sp_stack stack, void *arg) {
+  (void)stack;
+  (void)arg;
+  recurse(NULL, 0);
+}
+
+/**
+ * @brief Overflow a coroutine stack (in the child process)
+ * @param expected Pipe receiving the report the handler should write
+ */
+static void run_child(unsigned flags, int expected) {
+  sp_stack stack = init_stack_ex(16 * 1024, flags);
+  sp_ctx_attr attr = {.name = "deep"};
+  sp_ctx ctx = create_ctx_ex(stack, overflow, NULL, &attr);
+
+  char line[128];
+  int len = snprintf(line, sizeof(line),
+                     "stack overflow in ctx 0x%016" PRIxPTR
+                     " \"deep\" (fn 0x%016" PRIxPTR ")",
+                     (uintptr_t)ctx, (uintptr_t)overflow);
+  if (write(expected, line, (size_t)len) != len)
+    _exit(1);
+  close(expected);
+
+  switch_ctx(stack, ctx);
+  _exit(0); // Unreachable when the guard works
+}
+
+static int run(unsigned flags) {
+  int report[2], expected[2];
+  ASSERT_TRUE(pipe(report) == 0 && pipe(expected) == 0,
+              "pipes should be created");
+
+  pid_t pid = fork();
+  ASSERT_TRUE(pid >= 0, "child should be forked");
+  if (pid == 0) {
+    dup2(report[1], STDERR_FILENO);
+    close(report[0]);
+    close(expected[0]);
+    run_child(flags, expected[1]);
+  }
+  close(report[1]);
+  close(expected[1]);
+
+  int status = 0;
+  ASSERT_TRUE(waitpid(pid, &status, 0) == pid, "child should be reaped");
+
+  char text[512] = {0}, line[128] = {0};
+  ssize_t n = read(report[0], text, sizeof(text) - 1);
+  ASSERT_TRUE(read(expected[0], line, sizeof(line) - 1) > 0,
+              "child should reach the overflow");
+  close(report[0]);
+  close(expected[0]);
+
+  ASSERT_TRUE(WIFSIGNALED(status) && (WTERMSIG(status) == SIGSEGV ||
+                                      WTERMSIG(status) == SIGBUS),
+              "overflow should kill the child with the fault");
+  ASSERT_TRUE(n > 0 && strstr(text, line) != NULL,
+              "report should name the context and its function");
+  return 0;
+}
+
+int main(void) {
+  if (run(SP_STACK_GUARD) != 0)
+    return 1;
+  if (run(SP_STACK_ARENA | SP_STACK_GUARD) != 0)
+    return 1;
+
+  printf("test_guard_overflow passed\n");
+  return 0;
+}
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "coroutine.h"
+
+#define ASSERT_TRUE(cond, msg)                                                \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      fprintf(stderr, "FAIL: %s:%d: %s\n", __FILE__, __LINE__, (msg));        \
+      return 1;                                                               \
+    }                                                                         \
+  } while (0)
+
+#define STACK_SIZE (128 * 1024)
+#define DEEP (32 * 1024)
+#define SHALLOW 256
+#define SLACK (4 * 1024) // frames of the coroutine around its buffer
+
+// Uses `size` bytes of locals, and keeps them live across a yield
+static void use_stack(sp_stack stack, void *arg) {
+  size_t size = (size_t)arg;
+  volatile char buf[size];
+  for (size_t i = 0; i < size; i++)
+    buf[i] = 1;
+  yield_ctx(stack);
+  (void)buf[size - 1];
+}
+
+static void shallow(sp_stack stack, void *arg) {
+  (void)arg;
+  yield_ctx(stack);
+}
+
+static size_t run_one(sp_stack stack, sp_func fn, size_t size) {
+  sp_ctx ctx = create_ctx(stack, fn, (void *)size);
+  await_ctx(stack, ctx);
+  size_t used = ctx_stack_high_water(ctx);
+  destroy_ctx(ctx);
+  return used;
+}
+
+static int run(unsigned flags) {
+  sp_stack stack = init_stack_ex(STACK_SIZE, flags | SP_STACK_HIGH_WATER);
+
+  size_t deep = run_one(stack, use_stack, DEEP);
+  ASSERT_TRUE(deep >= DEEP && deep < DEEP + SLACK,
+              "deep coroutine should report its buffer");
+
+  // The recycled stack is cleared, so the deep run is not reported again
+  size_t small = run_one(stack, shallow, 0);
+  ASSERT_TRUE(small < SLACK, "shallow coroutine should report little");
+  ASSERT_TRUE(stack_high_water(stack) >= DEEP,
+              "aggregate should keep the peak of destroyed coroutines");
+
+  // Live contexts are measured too
+  sp_ctx ctx = create_ctx(stack, use_stack, (void *)(size_t)(DEEP / 2));
+  yield_ctx(stack);
+  size_t half = ctx_stack_high_water(ctx);
+  ASSERT_TRUE(half >= DEEP / 2 && half < DEEP / 2 + SLACK,
+              "suspended coroutine should report its usage");
+  await_ctx(stack, ctx);
+  destroy_ctx(ctx);
+
+  // Caller memory is cleared first: its old contents are not usage
+  char *memory = malloc(STACK_SIZE);
+  memset(memory, 0xa5, STACK_SIZE);
+  sp_ctx_attr attr = {.stack = memory, .stack_size = STACK_SIZE};
+  ctx = create_ctx_ex(stack, shallow, NULL, &attr);
+  await_ctx(stack, ctx);
+  ASSERT_TRUE(ctx_stack_high_water(ctx) < SLACK,
+              "user stack should report only what the coroutine used");
+  destroy_ctx(ctx);
+  free(memory);
+
+  deinit_stack(stack);
+  return 0;
+}
+
+int main(void) {
+  if (run(0) != 0)
+    return 1;
+  if (run(SP_STACK_ARENA | SP_STACK_GUARD | SP_STACK_LAZY) != 0)
+    return 1;
+
+  // Shared stack: per context only the frames saved at switch points
+  sp_stack stack = init_stack_ex(STACK_SIZE, SP_STACK_SHARED |
+                                                 SP_STACK_HIGH_WATER);
+  sp_ctx ctxs[2];
+  ctxs[0] = create_ctx(stack, use_stack, (void *)(size_t)DEEP);
+  ctxs[1] = create_ctx(stack, shallow, NULL);
+  for (int i = 0; i < 2; i++)
+    await_ctx(stack, ctxs[i]);
+  ASSERT_TRUE(ctx_stack_high_water(ctxs[0]) >= DEEP,
+              "suspended frames should be measured");
+  ASSERT_TRUE(ctx_stack_high_water(ctxs[1]) < SLACK,
+              "shallow coroutine should report little");
+  ASSERT_TRUE(stack_high_water(stack) >= DEEP,
+              "shared stack peak should cover the deep coroutine");
+  for (int i = 0; i < 2; i++)
+    destroy_ctx(ctxs[i]);
+  deinit_stack(stack);
+
+  printf("test_high_water passed\n");
+  return 0;
+}
@@ -0,0 +1,311 @@
+#include <stdio.h>
+
+#include "coroutine.h"
+
+#define ASSERT_TRUE(cond, msg)                                                \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      fprintf(stderr, "FAIL: %s:%d: %s\n", __FILE__, __LINE__, (msg));        \
+      return 1;                                                               \
+    }                                                                         \
+  } while (0)
+
+#ifdef __linux__
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BLOCK 512
+#define WRITERS 32
+
+// Buffers and addresses are used by the kernel while the context is parked:
+// they live on the heap, never on a (possibly shared) coroutine stack
+struct echo {
+  sp_reactor reactor;
+  int listener;
+  struct sockaddr_in *addr;
+  char *buf;
+  ssize_t res;
+};
+
+// Accepts one connection and sends back what it reads
+static void serve(sp_stack stack, void *arg) {
+  (void)stack;
+  struct echo *e = arg;
+  int fd = co_accept(e->reactor, e->listener, NULL, NULL);
+  if (fd < 0) {
+    e->res = fd;
+    return;
+  }
+
+  ssize_t n = co_read(e->reactor, fd, e->buf, BLOCK, -1);
+  e->res = n > 0 ? co_write(e->reactor, fd, e->buf, (size_t)n, -1) : n;
+  close(fd);
+}
+
+static int run_echo(unsigned flags) {
+  sp_stack stack = init_stack_ex(0, flags);
+  sp_reactor reactor = reactor_create(stack, 0);
+  ASSERT_TRUE(reactor != NULL, "reactor should be created");
+
+  struct echo *e = calloc(1, sizeof(*e));
+  e->reactor = reactor;
+  e->addr = calloc(1, sizeof(*e->addr));
+  e->buf = malloc(BLOCK);
+  e->addr->sin_family = AF_INET;
+  e->addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  // Port 0: the kernel picks a free port
+  socklen_t len = sizeof(*e->addr);
+  e->listener = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_TRUE(e->listener >= 0 &&
+                  bind(e->listener, (struct sockaddr *)e->addr, len) == 0 &&
+                  listen(e->listener, 1) == 0 &&
+                  getsockname(e->listener, (struct sockaddr *)e->addr,
+                              &len) == 0,
+              "listener should be set up");
+
+  sp_ctx server = create_ctx(stack, serve, e);
+
+  // Main does its I/O through the reactor too
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_TRUE(co_connect(reactor, fd, (struct sockaddr *)e->addr, len) == 0,
+              "client should connect");
+  char *msg = strdup("hello, ring");
+  char *reply = calloc(1, BLOCK);
+  ASSERT_TRUE(co_write(reactor, fd, msg, strlen(msg), -1) ==
+                  (ssize_t)strlen(msg),
+              "request should be written");
+  ASSERT_TRUE(co_read(reactor, fd, reply, BLOCK, -1) == (ssize_t)strlen(msg),
+              "reply should be read");
+  ASSERT_TRUE(strcmp(reply, msg) == 0, "reply should echo the request");
+
+  await_ctx(stack, server);
+  destroy_ctx(server);
+  ASSERT_TRUE(e->res == (ssize_t)strlen(msg), "server should echo");
+
+  // Errors come back as negative errno
+  ASSERT_TRUE(co_read(reactor, -1, reply, BLOCK, -1) == -EBADF,
+              "bad descriptor should fail");
+
+  close(fd);
+  close(e->listener);
+  free(reply);
+  free(msg);
+  free(e->buf);
+  free(e->addr);
+  free(e);
+  reactor_destroy(reactor);
+  deinit_stack(stack);
+  return 0;
+}
+
+struct writer {
+  sp_reactor reactor;
+  int fd;
+  size_t index;
+  char *block;
+  ssize_t res;
+};
+
+static void write_block(sp_stack stack, void *arg) {
+  (void)stack;
+  struct writer *w = arg;
+  memset(w->block, 'a' + (int)(w->index % 26), BLOCK);
+  w->res = co_write(w->reactor, w->fd, w->block, BLOCK,
+                    (off_t)(w->index * BLOCK));
+}
+
+static int run_file(unsigned flags) {
+  sp_stack stack = init_stack_ex(0, flags);
+  sp_reactor reactor = reactor_create(stack, 0);
+  ASSERT_TRUE(reactor != NULL, "reactor should be created");
+
+  char path[] = "/tmp/test_io_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_TRUE(fd >= 0, "temporary file should be created");
+  unlink(path);
+
+  // Every writer queues its write during the same pass: they are submitted
+  // together instead of one system call each
+  struct writer *writers = calloc(WRITERS, sizeof(*writers));
+  sp_ctx ctxs[WRITERS];
+  size_t submits = reactor_submit_count(reactor);
+  for (size_t i = 0; i < WRITERS; i++) {
+    writers[i] = (struct writer){reactor, fd, i, malloc(BLOCK), 0};
+    ctxs[i] = create_ctx(stack, write_block, &writers[i]);
+  }
+  for (size_t i = 0; i < WRITERS; i++) {
+    await_ctx(stack, ctxs[i]);
+    destroy_ctx(ctxs[i]);
+    ASSERT_TRUE(writers[i].res == BLOCK, "block should be written");
+  }
+  // Completions may still arrive one wait at a time
+  ASSERT_TRUE(reactor_submit_count(reactor) - submits == 1,
+              "writes should be submitted in one batch");
+
+  ASSERT_TRUE(co_fsync(reactor, fd) == 0, "file should be flushed");
+
+  char *block = malloc(BLOCK);
+  for (size_t i = 0; i < WRITERS; i++) {
+    ASSERT_TRUE(co_read(reactor, fd, block, BLOCK, (off_t)(i * BLOCK)) ==
+                    BLOCK,
+                "block should be read");
+    ASSERT_TRUE(memcmp(block, writers[i].block, BLOCK) == 0,
+                "block should read back as written");
+    free(writers[i].block);
+  }
+  ASSERT_TRUE(co_read(reactor, fd, block, BLOCK, WRITERS * BLOCK) == 0,
+              "read past the end should return 0");
+
+  free(block);
+  free(writers);
+  close(fd);
+  reactor_destroy(reactor);
+  deinit_stack(stack);
+  return 0;
+}
+
+static void pipe_reader(sp_stack stack, void *arg) {
+  (void)stack;
+  struct echo *e = arg;
+  e->res = co_read(e->reactor, e->listener, e->buf, BLOCK, -1);
+}
+
+// A context blocked on I/O and a sleeping one share the wait: neither
+// starves the other
+static int run_timers(void) {
+  sp_stack stack = init_stack(0);
+  sp_reactor reactor = reactor_create(stack, 0);
+  ASSERT_TRUE(reactor != NULL, "reactor should be created");
+
+  int fds[2];
+  ASSERT_TRUE(pipe(fds) == 0, "pipe should be created");
+  struct echo *e = calloc(1, sizeof(*e));
+  e->reactor = reactor;
+  e->listener = fds[0];
+  e->buf = malloc(BLOCK);
+
+  sp_ctx reader = create_ctx(stack, pipe_reader, e);
+  uint64_t start = get_time_ns();
+  sleep_ctx(stack, 10 * 1000000ull);
+  ASSERT_TRUE(get_time_ns() - start >= 10 * 1000000ull,
+              "main should sleep while the reader waits");
+  ASSERT_TRUE(e->res == 0, "reader should still wait");
+
+  ASSERT_TRUE(write(fds[1], "x", 1) == 1, "pipe should be written");
+  await_ctx(stack, reader);
+  destroy_ctx(reader);
+  ASSERT_TRUE(e->res == 1 && e->buf[0] == 'x', "reader should get the byte");
+
+  close(fds[0]);
+  close(fds[1]);
+  free(e->buf);
+  free(e);
+  reactor_destroy(reactor);
+  deinit_stack(stack);
+  return 0;
+}
+
+// Descriptor of the (only) io_uring instance of the process
+static int find_ring_fd(void) {
+  DIR *dir = opendir("/proc/self/fd");
+  if (dir == NULL)
+    return -1;
+
+  int fd = -1;
+  struct dirent *entry;
+  char path[300], target[64];
+  while (fd < 0 && (entry = readdir(dir)) != NULL) {
+    snprintf(path, sizeof(path), "/proc/self/fd/%s", entry->d_name);
+    ssize_t n = readlink(path, target, sizeof(target) - 1);
+    if (n > 0) {
+      target[n] = '\0';
+      if (strcmp(target, "anon_inode:[io_uring]") == 0)
+        fd = atoi(entry->d_name);
+    }
+  }
+
+  closedir(dir);
+  return fd;
+}
+
+// Runs after the reader queued its read, before the scheduler submits it
+static void break_ring(sp_stack stack, void *arg) {
+  (void)stack;
+  int *ring_fd = arg;
+  int null_fd = open("/dev/null", O_RDONLY);
+  dup2(null_fd, *ring_fd);
+  close(null_fd);
+}
+
+// io_uring_enter failing for good fails the queued operations
+static int run_broken(void) {
+  sp_stack stack = init_stack(0);
+  sp_reactor reactor = reactor_create(stack, 0);
+  ASSERT_TRUE(reactor != NULL, "reactor should be created");
+  int ring_fd = find_ring_fd();
+  ASSERT_TRUE(ring_fd >= 0, "ring descriptor should be found");
+
+  int fds[2];
+  ASSERT_TRUE(pipe(fds) == 0, "pipe should be created");
+  struct echo *e = calloc(1, sizeof(*e));
+  e->reactor = reactor;
+  e->listener = fds[0];
+  e->buf = malloc(BLOCK);
+
+  sp_ctx reader = create_ctx(stack, pipe_reader, e);
+  sp_ctx breaker = create_ctx(stack, break_ring, &ring_fd);
+  await_ctx(stack, reader);
+  await_ctx(stack, breaker);
+  destroy_ctx(reader);
+  destroy_ctx(breaker);
+  ASSERT_TRUE(e->res < 0, "queued read should fail");
+
+  close(fds[0]);
+  close(fds[1]);
+  free(e->buf);
+  free(e);
+  reactor_destroy(reactor);
+  deinit_stack(stack);
+  return 0;
+}
+
+int main(void) {
+  // io_uring may be missing (old kernel) or disabled (seccomp, sysctl)
+  sp_stack stack = init_stack(0);
+  sp_reactor reactor = reactor_create(stack, 0);
+  if (reactor == NULL) {
+    deinit_stack(stack);
+    printf("test_io passed (io_uring unavailable, skipped)\n");
+    return 0;
+  }
+  reactor_destroy(reactor);
+  deinit_stack(stack);
+
+  unsigned modes[] = {0, SP_STACK_SHARED};
+  for (size_t i = 0; i < 2; i++) {
+    if (run_echo(modes[i]) != 0 || run_file(modes[i]) != 0)
+      return 1;
+  }
+  if (run_timers() != 0 || run_broken() != 0)
+    return 1;
+
+  printf("test_io passed\n");
+  return 0;
+}
+
+#else
+
+int main(void) {
+  printf("test_io passed (Linux only, skipped)\n");
+  return 0;
+}
+
+#endif // __linux__
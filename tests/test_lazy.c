@@ -0,0 +1,133 @@
+#include <stdio.h>
+
+#include "coroutine.h"
+
+#define ASSERT_TRUE(cond, msg)                                                \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      fprintf(stderr, "FAIL: %s:%d: %s\n", __FILE__, __LINE__, (msg));        \
+      return 1;                                                               \
+    }                                                                         \
+  } while (0)
+
+#define COROUTINES 10000
+#define ROUNDS 3
+#define BATCH 256
+
+struct slot {
+  int id;
+  int runs;
+  int *order;
+  int *next;
+};
+
+// Records its start order, then yields a few times
+static void run_slot(sp_stack stack, void *arg) {
+  struct slot *s = arg;
+  s->order[(*s->next)++] = s->id;
+
+  volatile char frame[512]; // touch the stack mapped on first resume
+  for (size_t i = 0; i < sizeof(frame); i++)
+    frame[i] = (char)s->id;
+
+  for (int r = 0; r < ROUNDS; r++) {
+    s->runs++;
+    yield_ctx(stack);
+  }
+
+  if (frame[0] != (char)s->id)
+    s->runs = -1;
+}
+
+static struct slot slots[COROUTINES];
+static sp_ctx ctxs[COROUTINES];
+static int order[COROUTINES];
+
+static int run(unsigned flags) {
+  sp_stack stack = init_stack_ex(64 * 1024, flags | SP_STACK_LAZY);
+
+  for (int pass = 0; pass < 2; pass++) {
+    // The second pass reuses pooled (already mapped) contexts
+    int next = 0;
+    for (int i = 0; i < COROUTINES; i++) {
+      slots[i] = (struct slot){.id = i, .order = order, .next = &next};
+      ctxs[i] = create_ctx(stack, run_slot, &slots[i]);
+    }
+
+    // New contexts are queued at the tail: they start in creation order
+    for (int i = 0; i < COROUTINES; i++)
+      await_ctx(stack, ctxs[i]);
+
+    for (int i = 0; i < COROUTINES; i++) {
+      ASSERT_TRUE(slots[i].runs == ROUNDS, "every coroutine should run");
+      ASSERT_TRUE(order[i] == i, "start order mismatch");
+      destroy_ctx(ctxs[i]);
+    }
+  }
+
+  trim_pool(stack, 0);
+  deinit_stack(stack);
+  return 0;
+}
+
+static size_t count_mappings(void) {
+  size_t lines = 0;
+
+  FILE *f = fopen("/proc/self/maps", "r");
+  if (f == NULL)
+    return 0;
+  for (int c; (c = fgetc(f)) != EOF;)
+    lines += c == '\n';
+  fclose(f);
+
+  return lines;
+}
+
+// Stacks are only mapped on first resume. Guard pages keep neighbouring
+// stacks from merging into one mapping, so each shows up in the count.
+static int run_mappings(void) {
+  sp_stack stack = init_stack_ex(64 * 1024, SP_STACK_LAZY | SP_STACK_GUARD);
+  int next = 0;
+
+  size_t before = count_mappings();
+  for (int i = 0; i < BATCH; i++) {
+    slots[i] = (struct slot){.id = i, .order = order, .next = &next};
+    ctxs[i] = create_ctx(stack, run_slot, &slots[i]);
+  }
+  size_t created = count_mappings();
+
+  // Every coroutine starts, then suspends in its first yield
+  yield_ctx(stack);
+  size_t resumed = count_mappings();
+  ASSERT_TRUE(next == BATCH, "every coroutine should have started");
+
+  for (int i = 0; i < BATCH; i++) {
+    await_ctx(stack, ctxs[i]);
+    destroy_ctx(ctxs[i]);
+  }
+  trim_pool(stack, 0);
+  deinit_stack(stack);
+
+  // No /proc: nothing to check
+  if (before > 0) {
+    ASSERT_TRUE(created - before < BATCH / 4,
+                "lazy creation should not map stacks");
+    ASSERT_TRUE(resumed - created >= BATCH,
+                "first resume should map one stack per coroutine");
+  }
+  return 0;
+}
+
+int main(void) {
+  if (run(0) != 0)
+    return 1;
+  if (run(SP_STACK_ARENA | SP_STACK_GUARD) != 0)
+    return 1;
+  if (run(SP_STACK_SHARED) != 0)
+    return 1;
+  if (run_mappings() != 0)
+    return 1;
+
+  printf("test_lazy passed\n");
+  return 0;
+}
@@ -0,0 +1,88 @@
+#include <stdio.h>
+
+#include "coroutine.h"
+
+#define ASSERT_TRUE(cond, msg)                                                \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      fprintf(stderr, "FAIL: %s:%d: %s\n", __FILE__, __LINE__, (msg));        \
+      return 1;                                                               \
+    }                                                                         \
+  } while (0)
+
+#define WAITERS 16
+
+struct waiter {
+  int runs;
+  int woken;
+};
+
+static void wait_once(sp_stack stack, void *arg) {
+  struct waiter *w = arg;
+  w->runs++;
+  park_ctx(stack);
+  w->runs++;
+  w->woken = 1;
+}
+
+struct handoff {
+  int stage;
+};
+
+static void wake_main(sp_stack stack, void *arg) {
+  struct handoff *h = arg;
+  h->stage = 1;
+  unpark_ctx(stack, NULL);
+}
+
+int main(void) {
+  sp_stack stack = init_stack(0);
+
+  struct waiter waiters[WAITERS] = {0};
+  sp_ctx ctxs[WAITERS];
+  for (int i = 0; i < WAITERS; i++)
+    ctxs[i] = create_ctx(stack, wait_once, &waiters[i]);
+
+  yield_ctx(stack); // every waiter runs once and parks
+
+  // Parked contexts are not scheduled anymore
+  for (int round = 0; round < 10; round++)
+    yield_ctx(stack);
+  for (int i = 0; i < WAITERS; i++)
+    ASSERT_TRUE(waiters[i].runs == 1, "parked ctx should not be resumed");
+
+  // Wake a single waiter: only that one runs
+  unpark_ctx(stack, ctxs[3]);
+  unpark_ctx(stack, ctxs[3]); // unparking twice is harmless
+  yield_ctx(stack);
+  for (int i = 0; i < WAITERS; i++) {
+    ASSERT_TRUE(waiters[i].woken == (i == 3), "only the unparked ctx runs");
+  }
+  ASSERT_TRUE(is_ctx_finished(ctxs[3]), "woken ctx should finish");
+
+  // switch_ctx wakes a parked context up as well
+  switch_ctx(stack, ctxs[5]);
+  ASSERT_TRUE(is_ctx_finished(ctxs[5]), "switched-to ctx should finish");
+
+  for (int i = 0; i < WAITERS; i++)
+    unpark_ctx(stack, ctxs[i]);
+  yield_ctx(stack);
+  for (int i = 0; i < WAITERS; i++) {
+    ASSERT_TRUE(is_ctx_finished(ctxs[i]), "every waiter should finish");
+    destroy_ctx(ctxs[i]);
+  }
+
+  // Main can park too, until a coroutine wakes it up
+  struct handoff h = {0};
+  sp_ctx waker = create_ctx(stack, wake_main, &h);
+  park_ctx(stack);
+  ASSERT_TRUE(h.stage == 1, "main should be woken by the coroutine");
+  yield_ctx(stack);
+  ASSERT_TRUE(is_ctx_finished(waker), "waker should finish");
+  destroy_ctx(waker);
+
+  deinit_stack(stack);
+
+  printf("test_park passed\n");
+  return 0;
+}
@@ -0,0 +1,75 @@
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "coroutine.h"
+
+#define ASSERT_TRUE(cond, msg)                                                \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      fprintf(stderr, "FAIL: %s:%d: %s\n", __FILE__, __LINE__, (msg));        \
+      return 1;                                                               \
+    }                                                                         \
+  } while (0)
+
+#define WORKERS 4
+#define PARENTS 32
+#define CHILDREN 16
+#define YIELDS 8
+
+struct totals {
+  atomic_int children_done;
+  atomic_int steps;
+  atomic_int migrations;
+};
+
+static void child(sp_runtime rt, void *arg) {
+  struct totals *totals = arg;
+  size_t worker = runtime_worker_id(rt);
+
+  for (int i = 0; i < YIELDS; i++) {
+    atomic_fetch_add(&totals->steps, 1);
+    yield_task(rt);
+
+    size_t now = runtime_worker_id(rt);
+    if (now != worker) {
+      atomic_fetch_add(&totals->migrations, 1);
+      worker = now;
+    }
+  }
+
+  atomic_fetch_add(&totals->children_done, 1);
+}
+
+static void parent(sp_runtime rt, void *arg) {
+  // Fan out from inside the runtime (pushed on the worker's own deque)
+  for (int i = 0; i < CHILDREN; i++) {
+    spawn_task(rt, child, arg);
+    yield_task(rt);
+  }
+}
+
+int main(void) {
+  sp_runtime rt = init_runtime(WORKERS, 64 * 1024);
+  struct totals totals = {0};
+
+  for (int i = 0; i < PARENTS; i++)
+    spawn_task(rt, parent, &totals);
+
+  wait_runtime(rt);
+
+  ASSERT_TRUE(atomic_load(&totals.children_done) == PARENTS * CHILDREN,
+              "every child task should finish");
+  ASSERT_TRUE(atomic_load(&totals.steps) == PARENTS * CHILDREN * YIELDS,
+              "every child step should run exactly once");
+
+  // The runtime can be reused after a wait
+  spawn_task(rt, child, &totals);
+  deinit_runtime(rt);
+
+  ASSERT_TRUE(atomic_load(&totals.children_done) == PARENTS * CHILDREN + 1,
+              "tasks spawned after a wait should run");
+
+  printf("test_runtime passed (%d migrations)\n",
+         atomic_load(&totals.migrations));
+  return 0;
+}
@@ -0,0 +1,128 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "coroutine.h"
+
+#define ASSERT_TRUE(cond, msg)                                                \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      fprintf(stderr, "FAIL: %s:%d: %s\n", __FILE__, __LINE__, (msg));        \
+      return 1;                                                               \
+    }                                                                         \
+  } while (0)
+
+#define STACK_SIZE (512 * 1024)
+#define DEEP_SIZE (256 * 1024)
+#define HOUR_NS (3600ull * 1000000000ull)
+
+// Dirties `size` bytes through volatile stores, which are never elided
+static void dirty(volatile unsigned char *bytes, size_t size) {
+  for (size_t i = 0; i < size; i += 512)
+    bytes[i] = 1;
+}
+
+// Kept out of line so that its frame is gone once it returns
+__attribute__((noinline)) static void go_deep(sp_stack stack, void *arg) {
+  (void)stack;
+  (void)arg;
+  volatile unsigned char deep[DEEP_SIZE];
+  dirty(deep, sizeof(deep));
+}
+
+// Goes deep once, then sits suspended in a shallow frame
+static void deep_then_idle(sp_stack stack, void *arg) {
+  size_t *checksum = arg;
+  volatile unsigned char shallow[64];
+  for (size_t i = 0; i < sizeof(shallow); i++)
+    shallow[i] = 7;
+
+  go_deep(stack, NULL);
+
+  yield_ctx(stack);
+
+  // The live frames above the saved stack pointer are untouched
+  for (size_t i = 0; i < sizeof(shallow); i++)
+    *checksum += shallow[i];
+}
+
+static int run(unsigned flags) {
+  sp_stack stack = init_stack_ex(STACK_SIZE, flags);
+  size_t checksum = 0;
+
+  sp_ctx ctx = create_ctx(stack, deep_then_idle, &checksum);
+  yield_ctx(stack);
+
+  ASSERT_TRUE(scavenge_stack(stack, HOUR_NS) == 0,
+              "recently run contexts should be kept");
+  size_t released = scavenge_stack(stack, 0);
+  ASSERT_TRUE(released >= DEEP_SIZE - 4096,
+              "pages below a suspended context should be released");
+  ASSERT_TRUE(scavenge_stack(stack, 0) == 0,
+              "released pages should not be counted twice");
+  if (flags & SP_STACK_HIGH_WATER)
+    ASSERT_TRUE(ctx_stack_high_water(ctx) >= DEEP_SIZE,
+                "high-water mark should survive released pages");
+
+  await_ctx(stack, ctx);
+  ASSERT_TRUE(checksum == 7 * 64, "live frames should be preserved");
+  destroy_ctx(ctx);
+
+  // Pooled stacks are released too, and still work when reused
+  size_t before = get_scavenged_bytes(stack);
+  ctx = create_ctx(stack, go_deep, NULL);
+  await_ctx(stack, ctx);
+  destroy_ctx(ctx);
+  released = scavenge_stack(stack, 0);
+  ASSERT_TRUE(released >= DEEP_SIZE, "pooled stacks should be released");
+  ASSERT_TRUE(get_scavenged_bytes(stack) == before + released,
+              "counter should add up the released bytes");
+
+  ctx = create_ctx(stack, go_deep, NULL);
+  await_ctx(stack, ctx);
+  destroy_ctx(ctx);
+
+  trim_pool(stack, 0);
+  deinit_stack(stack);
+  return 0;
+}
+
+static void deep_task(sp_runtime rt, void *arg) {
+  (void)rt;
+  go_deep(NULL, arg);
+}
+
+static int run_runtime(void) {
+  sp_runtime rt = init_runtime(2, STACK_SIZE);
+  set_runtime_scavenge(rt, 1);
+
+  for (size_t i = 0; i < 8; i++)
+    spawn_task(rt, deep_task, NULL);
+  wait_runtime(rt);
+
+  // Idle workers scavenge their pool on a timer
+  struct timespec pause = {0, 10 * 1000 * 1000};
+  for (size_t i = 0; i < 100 && runtime_scavenged_bytes(rt) < DEEP_SIZE; i++)
+    nanosleep(&pause, NULL);
+  ASSERT_TRUE(runtime_scavenged_bytes(rt) >= DEEP_SIZE,
+              "idle workers should release pooled stacks");
+
+  deinit_runtime(rt);
+  return 0;
+}
+
+int main(void) {
+  if (run(0) != 0)
+    return 1;
+  if (run(SP_STACK_GUARD) != 0)
+    return 1;
+  if (run(SP_STACK_ARENA) != 0)
+    return 1;
+  if (run(SP_STACK_HIGH_WATER) != 0)
+    return 1;
+  if (run_runtime() != 0)
+    return 1;
+
+  printf("test_scavenge passed\n");
+  return 0;
+}
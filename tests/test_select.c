@@ -0,0 +1,133 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "coroutine.h"
+
+#define ASSERT_TRUE(cond, msg)                                                \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      fprintf(stderr, "FAIL: %s:%d: %s\n", __FILE__, __LINE__, (msg));        \
+      return 1;                                                               \
+    }                                                                         \
+  } while (0)
+
+#define INPUTS 3
+#define MESSAGES 500
+
+struct input {
+  sp_chan chan;
+  uintptr_t first;
+};
+
+static void produce(sp_stack stack, void *arg) {
+  (void)stack;
+  struct input *in = arg;
+  for (uintptr_t i = 0; i < MESSAGES; i++)
+    chan_send(in->chan, (void *)(in->first + i));
+  chan_close(in->chan);
+}
+
+static void recv_one(sp_stack stack, void *arg) {
+  (void)stack;
+  void *value;
+  chan_recv(arg, &value);
+}
+
+static int run_ready_cases(unsigned flags) {
+  sp_stack stack = init_stack_ex(0, flags);
+  sp_chan a = chan_create(stack, 4);
+  sp_chan b = chan_create(stack, 4);
+  sp_chan_case cases[] = {{.chan = a}, {.chan = b}};
+
+  ASSERT_TRUE(chan_select(cases, 2, false) == -1,
+              "nothing should be ready on empty channels");
+
+  chan_send(a, (void *)1);
+  chan_send(b, (void *)2);
+  ASSERT_TRUE(chan_select(cases, 2, true) == 0 && cases[0].ok &&
+                  (uintptr_t)cases[0].value == 1,
+              "earlier ready cases should take priority");
+  ASSERT_TRUE(chan_select(cases, 2, true) == 1 &&
+                  (uintptr_t)cases[1].value == 2,
+              "later cases should be taken when earlier ones are not ready");
+
+  // A full channel only accepts a send once a receiver frees a slot
+  for (uintptr_t i = 0; i < 4; i++)
+    chan_send(a, (void *)i);
+  sp_chan_case send_or_recv[] = {{.chan = a, .send = true, .value = (void *)9},
+                                 {.chan = b}};
+  ASSERT_TRUE(chan_select(send_or_recv, 2, false) == -1,
+              "send to a full channel should not be ready");
+
+  sp_ctx receiver = create_ctx(stack, recv_one, a);
+  ASSERT_TRUE(chan_select(send_or_recv, 2, true) == 0 && send_or_recv[0].ok,
+              "send should complete once a slot is freed");
+  await_ctx(stack, receiver);
+  destroy_ctx(receiver);
+
+  // The receive case was withdrawn: the next send is buffered
+  chan_send(b, (void *)3);
+  ASSERT_TRUE(chan_len(b) == 1, "withdrawn case should not receive");
+
+  chan_destroy(a);
+  chan_destroy(b);
+  deinit_stack(stack);
+  return 0;
+}
+
+static int run_router(unsigned flags, size_t capacity) {
+  sp_stack stack = init_stack_ex(0, flags);
+  struct input inputs[INPUTS];
+  sp_chan_case cases[INPUTS];
+  sp_ctx producers[INPUTS];
+
+  for (size_t i = 0; i < INPUTS; i++) {
+    inputs[i] = (struct input){chan_create(stack, capacity),
+                               1 + i * MESSAGES};
+    cases[i] = (sp_chan_case){.chan = inputs[i].chan};
+    producers[i] = create_ctx(stack, produce, &inputs[i]);
+  }
+
+  // Main waits on every input at once until all of them are closed
+  uintptr_t sum = 0;
+  size_t received = 0;
+  size_t open = INPUTS;
+  while (open > 0) {
+    int i = chan_select(cases, open, true);
+    ASSERT_TRUE(i >= 0 && (size_t)i < open, "select should pick a case");
+
+    if (cases[i].ok) {
+      sum += (uintptr_t)cases[i].value;
+      received++;
+    } else {
+      cases[i] = cases[--open];
+    }
+  }
+
+  size_t n = INPUTS * MESSAGES;
+  ASSERT_TRUE(received == n, "every message should be received");
+  ASSERT_TRUE(sum == n * (n + 1) / 2, "every message should be received once");
+
+  // chan_destroy asserts that no select waiter was left behind
+  for (size_t i = 0; i < INPUTS; i++) {
+    await_ctx(stack, producers[i]);
+    destroy_ctx(producers[i]);
+    chan_destroy(inputs[i].chan);
+  }
+  deinit_stack(stack);
+  return 0;
+}
+
+int main(void) {
+  unsigned modes[] = {0, SP_STACK_SHARED};
+
+  for (size_t i = 0; i < 2; i++) {
+    if (run_ready_cases(modes[i]) != 0)
+      return 1;
+    if (run_router(modes[i], 0) != 0 || run_router(modes[i], 8) != 0)
+      return 1;
+  }
+
+  printf("test_select passed\n");
+  return 0;
+}
@@ -0,0 +1,106 @@
+#include <stdio.h>
+
+#include "coroutine.h"
+
+#define ASSERT_TRUE(cond, msg)                                                \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      fprintf(stderr, "FAIL: %s:%d: %s\n", __FILE__, __LINE__, (msg));        \
+      return 1;                                                               \
+    }                                                                         \
+  } while (0)
+
+#define WORKERS 8
+#define ROUNDS 16
+
+struct worker {
+  int id;
+  int corrupted;
+  int rounds;
+};
+
+static int depth_check(sp_stack stack, struct worker *w, int depth) {
+  // Locals live on the shared stack and must survive other coroutines
+  // running on the same memory in between
+  volatile int local[64];
+  for (int i = 0; i < 64; i++)
+    local[i] = w->id * 1000 + depth * 64 + i;
+
+  yield_ctx(stack);
+
+  int bad = 0;
+  for (int i = 0; i < 64; i++)
+    bad += local[i] != w->id * 1000 + depth * 64 + i;
+
+  if (depth > 0)
+    bad += depth_check(stack, w, depth - 1);
+  return bad;
+}
+
+static void worker(sp_stack stack, void *arg) {
+  struct worker *w = arg;
+  for (int r = 0; r < ROUNDS; r++) {
+    w->corrupted += depth_check(stack, w, w->id % 4);
+    w->rounds++;
+  }
+}
+
+struct pair {
+  sp_ctx partner;
+  int turns;
+};
+
+static void ping_pong(sp_stack stack, void *arg) {
+  struct pair *p = arg;
+  for (int i = 0; i < 5; i++) {
+    p->turns++;
+    if (!is_ctx_finished(p->partner))
+      switch_ctx(stack, p->partner);
+  }
+}
+
+int main(void) {
+  sp_stack stack = init_stack_ex(64 * 1024, SP_STACK_SHARED);
+
+  struct worker workers[WORKERS];
+  sp_ctx ctxs[WORKERS];
+
+  for (int i = 0; i < WORKERS; i++) {
+    workers[i] = (struct worker){.id = i + 1, .corrupted = 0, .rounds = 0};
+    ctxs[i] = create_ctx(stack, worker, &workers[i]);
+  }
+
+  int finished = 0;
+  while (!finished) {
+    yield_ctx(stack);
+    finished = 1;
+    for (int i = 0; i < WORKERS; i++)
+      finished &= is_ctx_finished(ctxs[i]);
+  }
+
+  for (int i = 0; i < WORKERS; i++) {
+    ASSERT_TRUE(workers[i].rounds == ROUNDS, "worker should finish all rounds");
+    ASSERT_TRUE(workers[i].corrupted == 0, "stack locals should be preserved");
+    destroy_ctx(ctxs[i]);
+  }
+
+  // Direct handoff between two coroutines of the shared stack
+  struct pair ping = {0}, pong = {0};
+  sp_ctx ping_ctx = create_ctx(stack, ping_pong, &ping);
+  sp_ctx pong_ctx = create_ctx(stack, ping_pong, &pong);
+  ping.partner = pong_ctx;
+  pong.partner = ping_ctx;
+
+  switch_ctx(stack, ping_ctx);
+  while (!is_ctx_finished(ping_ctx) || !is_ctx_finished(pong_ctx))
+    yield_ctx(stack);
+
+  ASSERT_TRUE(ping.turns == 5 && pong.turns == 5, "ping pong should alternate");
+
+  destroy_ctx(ping_ctx);
+  destroy_ctx(pong_ctx);
+  deinit_stack(stack);
+
+  printf("test_shared_stack passed\n");
+  return 0;
+}
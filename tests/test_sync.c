@@ -0,0 +1,227 @@
+#include <stdio.h>
+
+#include "coroutine.h"
+
+#define ASSERT_TRUE(cond, msg)                                                \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      fprintf(stderr, "FAIL: %s:%d: %s\n", __FILE__, __LINE__, (msg));        \
+      return 1;                                                               \
+    }                                                                         \
+  } while (0)
+
+#define WORKERS 6
+#define ROUNDS 100
+
+struct shared {
+  sp_mutex mutex;
+  sp_cond cond;
+  sp_sem sem;
+  size_t value;
+  size_t ready;
+  size_t active;
+  size_t max_active;
+  size_t arrival[WORKERS]; // Workers in the order they started waiting
+  size_t arrived;
+  size_t order[WORKERS]; // Workers in the order they got through
+  size_t done;
+};
+
+struct worker {
+  struct shared *shared;
+  size_t id;
+};
+
+// Yields inside the critical section: without the mutex, updates get lost
+static void add(sp_stack stack, void *arg) {
+  struct shared *s = ((struct worker *)arg)->shared;
+  for (size_t i = 0; i < ROUNDS; i++) {
+    mutex_lock(s->mutex);
+    size_t value = s->value;
+    yield_ctx(stack);
+    s->value = value + 1;
+    mutex_unlock(s->mutex);
+  }
+}
+
+static void lock_once(sp_stack stack, void *arg) {
+  (void)stack;
+  struct worker *w = arg;
+  w->shared->arrival[w->shared->arrived++] = w->id;
+  mutex_lock(w->shared->mutex);
+  w->shared->order[w->shared->done++] = w->id;
+  mutex_unlock(w->shared->mutex);
+}
+
+static int run_mutex(unsigned flags) {
+  sp_stack stack = init_stack_ex(0, flags);
+  struct shared s = {.mutex = mutex_create(stack)};
+  struct worker workers[WORKERS];
+  sp_ctx ctxs[WORKERS];
+
+  for (size_t i = 0; i < WORKERS; i++) {
+    workers[i] = (struct worker){&s, i};
+    ctxs[i] = create_ctx(stack, add, &workers[i]);
+  }
+  for (size_t i = 0; i < WORKERS; i++) {
+    await_ctx(stack, ctxs[i]);
+    destroy_ctx(ctxs[i]);
+  }
+  ASSERT_TRUE(s.value == WORKERS * ROUNDS, "no update should be lost");
+
+  // Waiters get the mutex in arrival order, and unlocking hands it over
+  mutex_lock(s.mutex);
+  for (size_t i = 0; i < WORKERS; i++)
+    ctxs[i] = create_ctx(stack, lock_once, &workers[i]);
+  yield_ctx(stack);
+  mutex_unlock(s.mutex);
+  ASSERT_TRUE(!mutex_try_lock(s.mutex),
+              "unlocked mutex should belong to the oldest waiter");
+
+  for (size_t i = 0; i < WORKERS; i++) {
+    await_ctx(stack, ctxs[i]);
+    destroy_ctx(ctxs[i]);
+    ASSERT_TRUE(s.order[i] == s.arrival[i],
+                "waiters should lock in FIFO order");
+  }
+  ASSERT_TRUE(mutex_try_lock(s.mutex), "free mutex should be lockable");
+  mutex_unlock(s.mutex);
+
+  mutex_destroy(s.mutex);
+  deinit_stack(stack);
+  return 0;
+}
+
+static void wait_ready(sp_stack stack, void *arg) {
+  (void)stack;
+  struct worker *w = arg;
+  struct shared *s = w->shared;
+
+  mutex_lock(s->mutex);
+  s->arrival[s->arrived++] = w->id;
+  while (s->ready == 0)
+    cond_wait(s->cond, s->mutex);
+  s->order[s->done++] = w->id;
+  mutex_unlock(s->mutex);
+}
+
+static int run_cond(unsigned flags) {
+  sp_stack stack = init_stack_ex(0, flags);
+  struct shared s = {.mutex = mutex_create(stack), .cond = cond_create(stack)};
+  struct worker workers[WORKERS];
+  sp_ctx ctxs[WORKERS];
+
+  for (size_t i = 0; i < WORKERS; i++) {
+    workers[i] = (struct worker){&s, i};
+    ctxs[i] = create_ctx(stack, wait_ready, &workers[i]);
+  }
+  yield_ctx(stack);
+  ASSERT_TRUE(s.done == 0, "waiters should be parked");
+
+  // A signal wakes exactly one waiter
+  mutex_lock(s.mutex);
+  s.ready = 1;
+  cond_signal(s.cond);
+  mutex_unlock(s.mutex);
+  yield_ctx(stack);
+  ASSERT_TRUE(s.done == 1 && s.order[0] == s.arrival[0],
+              "oldest waiter should wake");
+
+  // A broadcast wakes the others, each owning the mutex in turn
+  mutex_lock(s.mutex);
+  cond_broadcast(s.cond);
+  mutex_unlock(s.mutex);
+  for (size_t i = 0; i < WORKERS; i++) {
+    await_ctx(stack, ctxs[i]);
+    destroy_ctx(ctxs[i]);
+    ASSERT_TRUE(s.order[i] == s.arrival[i],
+                "waiters should wake in FIFO order");
+  }
+
+  cond_destroy(s.cond);
+  mutex_destroy(s.mutex);
+  deinit_stack(stack);
+  return 0;
+}
+
+// Broadcast then destroy: the woken waiters still queue on the mutex
+static int run_cond_destroy(unsigned flags) {
+  sp_stack stack = init_stack_ex(0, flags);
+  struct shared s = {.mutex = mutex_create(stack), .cond = cond_create(stack)};
+  struct worker workers[WORKERS];
+  sp_ctx ctxs[WORKERS];
+
+  for (size_t i = 0; i < WORKERS; i++) {
+    workers[i] = (struct worker){&s, i};
+    ctxs[i] = create_ctx(stack, wait_ready, &workers[i]);
+  }
+  yield_ctx(stack);
+
+  mutex_lock(s.mutex);
+  s.ready = 1;
+  cond_broadcast(s.cond);
+  cond_destroy(s.cond);
+  mutex_unlock(s.mutex);
+
+  for (size_t i = 0; i < WORKERS; i++) {
+    await_ctx(stack, ctxs[i]);
+    destroy_ctx(ctxs[i]);
+  }
+  ASSERT_TRUE(s.done == WORKERS, "every waiter should wake up");
+
+  mutex_destroy(s.mutex);
+  deinit_stack(stack);
+  return 0;
+}
+
+static void bounded(sp_stack stack, void *arg) {
+  struct shared *s = ((struct worker *)arg)->shared;
+  sema_acquire(s->sem);
+  if (++s->active > s->max_active)
+    s->max_active = s->active;
+  for (size_t i = 0; i < 3; i++)
+    yield_ctx(stack);
+  s->active--;
+  sema_release(s->sem);
+}
+
+static int run_sema(unsigned flags) {
+  sp_stack stack = init_stack_ex(0, flags);
+  struct shared s = {.sem = sema_create(stack, 2)};
+  struct worker workers[WORKERS];
+  sp_ctx ctxs[WORKERS];
+
+  for (size_t i = 0; i < WORKERS; i++) {
+    workers[i] = (struct worker){&s, i};
+    ctxs[i] = create_ctx(stack, bounded, &workers[i]);
+  }
+  for (size_t i = 0; i < WORKERS; i++) {
+    await_ctx(stack, ctxs[i]);
+    destroy_ctx(ctxs[i]);
+  }
+  ASSERT_TRUE(s.max_active == 2, "at most two holders at once");
+  ASSERT_TRUE(sema_count(s.sem) == 2, "every unit should be given back");
+
+  ASSERT_TRUE(sema_try_acquire(s.sem) && sema_try_acquire(s.sem),
+              "free units should be taken");
+  ASSERT_TRUE(!sema_try_acquire(s.sem), "no unit should be left");
+  sema_release(s.sem);
+  sema_release(s.sem);
+
+  sema_destroy(s.sem);
+  deinit_stack(stack);
+  return 0;
+}
+
+int main(void) {
+  unsigned modes[] = {0, SP_STACK_SHARED};
+
+  for (size_t i = 0; i < 2; i++) {
+    if (run_mutex(modes[i]) != 0 || run_cond(modes[i]) != 0 ||
+        run_cond_destroy(modes[i]) != 0 || run_sema(modes[i]) != 0)
+      return 1;
+  }
+
+  printf("test_sync passed\n");
+  return 0;
+}
@@ -0,0 +1,176 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "coroutine.h"
+
+#define ASSERT_TRUE(cond, msg)                                                \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      fprintf(stderr, "FAIL: %s:%d: %s\n", __FILE__, __LINE__, (msg));        \
+      return 1;                                                               \
+    }                                                                         \
+  } while (0)
+
+#define MS 1000000ull
+#define SLEEPERS 1000
+
+struct sleeper {
+  uint64_t ns;
+  uint64_t woke; // get_time_ns after waking up
+  size_t rank;   // Wake-up order
+};
+
+static size_t woken;
+
+static void sleep_for(sp_stack stack, void *arg) {
+  struct sleeper *s = arg;
+  sleep_ctx(stack, s->ns);
+  s->woke = get_time_ns();
+  s->rank = woken++;
+}
+
+static int run_sleep(unsigned flags) {
+  sp_stack stack = init_stack_ex(0, flags);
+  // Spread over the first two levels of the wheel (64 ticks ~ 67 ms)
+  uint64_t durations[] = {30 * MS, 5 * MS, 120 * MS, 10 * MS, 0};
+  size_t ranks[] = {3, 1, 4, 2, 0};
+  struct sleeper sleepers[5];
+  sp_ctx ctxs[5];
+
+  woken = 0;
+  uint64_t start = get_time_ns();
+  for (size_t i = 0; i < 5; i++) {
+    sleepers[i] = (struct sleeper){.ns = durations[i]};
+    ctxs[i] = create_ctx(stack, sleep_for, &sleepers[i]);
+  }
+
+  // Main sleeps too: with every context parked, the thread sleeps until
+  // the next timer expires
+  sleep_ctx(stack, 60 * MS);
+  ASSERT_TRUE(get_time_ns() - start >= 60 * MS, "main should sleep 60 ms");
+  ASSERT_TRUE(woken == 4, "shorter sleepers should be awake");
+
+  for (size_t i = 0; i < 5; i++) {
+    await_ctx(stack, ctxs[i]);
+    destroy_ctx(ctxs[i]);
+    ASSERT_TRUE(sleepers[i].woke - start >= durations[i],
+                "sleepers should never wake up early");
+    ASSERT_TRUE(sleepers[i].rank == ranks[i],
+                "sleepers should wake up by deadline");
+  }
+
+  deinit_stack(stack);
+  return 0;
+}
+
+static void park_until(sp_stack stack, void *arg) {
+  uint64_t *deadline = arg;
+  set_ctx_result(stack, (void *)(uintptr_t)park_ctx_until(stack, *deadline));
+}
+
+static int run_park_until(void) {
+  sp_stack stack = init_stack(0);
+
+  // Woken up before the deadline: the timer is cancelled
+  uint64_t deadline = get_time_ns() + 20 * MS;
+  sp_ctx ctx = create_ctx(stack, park_until, &deadline);
+  yield_ctx(stack);
+  unpark_ctx(stack, ctx);
+  ASSERT_TRUE(await_ctx(stack, ctx) != NULL,
+              "unparked context should not time out");
+  destroy_ctx(ctx);
+
+  // The cancelled timer does not fire later
+  sleep_ctx(stack, 30 * MS);
+
+  // Deadlines past the wheel horizon (~4.9 hours) wait in the overflow list
+  deadline = get_time_ns() + 10 * 3600 * 1000 * MS;
+  ctx = create_ctx(stack, park_until, &deadline);
+  yield_ctx(stack);
+  unpark_ctx(stack, ctx);
+  ASSERT_TRUE(await_ctx(stack, ctx) != NULL, "far timer should be cancelled");
+  destroy_ctx(ctx);
+
+  // Expired deadline: returns at once
+  deadline = get_time_ns() - 1;
+  ASSERT_TRUE(!park_ctx_until(stack, deadline), "past deadline should expire");
+
+  deadline = get_time_ns() + 5 * MS;
+  ctx = create_ctx(stack, park_until, &deadline);
+  ASSERT_TRUE(await_ctx(stack, ctx) == NULL, "context should time out");
+  ASSERT_TRUE(get_time_ns() >= deadline, "timer should not fire early");
+  destroy_ctx(ctx);
+
+  deinit_stack(stack);
+  return 0;
+}
+
+static int run_many(void) {
+  sp_stack stack = init_stack_ex(0, SP_STACK_SHARED);
+  static struct sleeper sleepers[SLEEPERS];
+  static sp_ctx ctxs[SLEEPERS];
+
+  woken = 0;
+  uint64_t start = get_time_ns();
+  for (size_t i = 0; i < SLEEPERS; i++) {
+    // Pseudo-random durations up to 100 ms
+    sleepers[i] = (struct sleeper){.ns = (i * 7919 % 1000) * MS / 10};
+    ctxs[i] = create_ctx(stack, sleep_for, &sleepers[i]);
+  }
+
+  for (size_t i = 0; i < SLEEPERS; i++) {
+    await_ctx(stack, ctxs[i]);
+    destroy_ctx(ctxs[i]);
+    ASSERT_TRUE(sleepers[i].woke - start >= sleepers[i].ns,
+                "sleepers should never wake up early");
+  }
+  ASSERT_TRUE(woken == SLEEPERS, "every sleeper should wake up");
+
+  deinit_stack(stack);
+  return 0;
+}
+
+static void send_later(sp_stack stack, void *arg) {
+  sleep_ctx(stack, 10 * MS);
+  chan_send(arg, (void *)7);
+}
+
+static int run_select_until(void) {
+  sp_stack stack = init_stack(0);
+  sp_chan a = chan_create(stack, 0);
+  sp_chan b = chan_create(stack, 0);
+  sp_chan_case cases[] = {{.chan = a}, {.chan = b}};
+
+  uint64_t deadline = get_time_ns() + 5 * MS;
+  ASSERT_TRUE(chan_select_until(cases, 2, deadline) == -1,
+              "select should time out");
+  ASSERT_TRUE(get_time_ns() >= deadline, "select should wait until deadline");
+
+  sp_ctx sender = create_ctx(stack, send_later, b);
+  deadline = get_time_ns() + 1000 * MS;
+  ASSERT_TRUE(chan_select_until(cases, 2, deadline) == 1 &&
+                  (uintptr_t)cases[1].value == 7,
+              "select should complete before the deadline");
+  await_ctx(stack, sender);
+  destroy_ctx(sender);
+
+  // chan_destroy asserts that timed out cases were withdrawn
+  chan_destroy(a);
+  chan_destroy(b);
+  deinit_stack(stack);
+  return 0;
+}
+
+int main(void) {
+  if (run_sleep(0) != 0 || run_sleep(SP_STACK_SHARED) != 0)
+    return 1;
+  if (run_park_until() != 0)
+    return 1;
+  if (run_many() != 0)
+    return 1;
+  if (run_select_until() != 0)
+    return 1;
+
+  printf("test_timer passed\n");
+  return 0;
+}
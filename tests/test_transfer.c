@@ -0,0 +1,99 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "coroutine.h"
+
+#define ASSERT_TRUE(cond, msg)                                                \
+  do {                                                                        \
+    if (!(cond)) {                                                            \
+      fprintf(stderr, "FAIL: %s:%d: %s\n", __FILE__, __LINE__, (msg));        \
+      return 1;                                                               \
+    }                                                                         \
+  } while (0)
+
+#define REQUESTS 1000
+
+// Squares every request until it receives 0, without touching shared memory
+static void square_server(sp_stack stack, void *arg) {
+  (void)arg;
+  uintptr_t request = (uintptr_t)transfer_ctx(stack, NULL, NULL);
+
+  while (request != 0)
+    request = (uintptr_t)transfer_ctx(stack, NULL,
+                                      (void *)(request * request));
+}
+
+struct observed {
+  void *first;
+  void *second;
+  sp_ctx other;
+};
+
+static void yield_back(sp_stack stack, void *arg) {
+  (void)arg;
+  yield_ctx(stack);
+}
+
+static void record(sp_stack stack, void *arg) {
+  struct observed *o = arg;
+
+  // The value is dropped as `other` has not started yet
+  o->first = transfer_ctx(stack, o->other, (void *)1);
+  o->second = transfer_ctx(stack, NULL, (void *)2);
+}
+
+static int run(unsigned flags) {
+  sp_stack stack = init_stack_ex(0, flags);
+
+  // Request/response handoff
+  sp_ctx server = create_ctx(stack, square_server, NULL);
+  ASSERT_TRUE(transfer_ctx(stack, server, NULL) == NULL,
+              "server should start and ask for its first request");
+
+  for (uintptr_t i = 1; i <= REQUESTS; i++) {
+    uintptr_t response = (uintptr_t)transfer_ctx(stack, server, (void *)i);
+    ASSERT_TRUE(response == i * i, "response should be the square of i");
+  }
+
+  ASSERT_TRUE(transfer_ctx(stack, server, (void *)0) == NULL,
+              "finished server should hand back no value");
+  ASSERT_TRUE(is_ctx_finished(server), "server should finish on request 0");
+  destroy_ctx(server);
+
+  // Contexts resumed without a value receive NULL
+  struct observed o = {0};
+  sp_ctx recorder = create_ctx(stack, record, &o);
+  o.other = create_ctx(stack, yield_back, NULL);
+
+  ASSERT_TRUE(transfer_ctx(stack, recorder, NULL) == NULL,
+              "main resumed by yield_ctx should receive NULL");
+  ASSERT_TRUE(transfer_ctx(stack, recorder, (void *)3) == (void *)2,
+              "recorder should hand back 2");
+  ASSERT_TRUE(o.first == (void *)3, "recorder should receive 3");
+  ASSERT_TRUE(transfer_ctx(stack, recorder, (void *)4) == NULL,
+              "main resumed by a finishing context should receive NULL");
+  ASSERT_TRUE(o.second == (void *)4, "recorder should receive 4");
+  ASSERT_TRUE(is_ctx_finished(recorder), "recorder should be finished");
+
+  while (!is_ctx_finished(o.other))
+    yield_ctx(stack);
+  destroy_ctx(recorder);
+  destroy_ctx(o.other);
+
+  // Transferring to the running context returns the value right away
+  ASSERT_TRUE(transfer_ctx(stack, NULL, (void *)5) == (void *)5,
+              "transfer to self should return its value");
+
+  deinit_stack(stack);
+  return 0;
+}
+
+int main(void) {
+  if (run(0) != 0)
+    return 1;
+  if (run(SP_STACK_SHARED) != 0)
+    return 1;
+
+  printf("test_transfer passed\n");
+  return 0;
+}
@@ -1,3 +1,4 @@
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -26,7 +27,109 @@ static void logger(sp_stack stack, void *arg) {
   }
 }
 
+// Every scheduling round (between two main entries) must visit each live
+// coroutine exactly once and in the same order, even after completions
+static int check_stable_rounds(void) {
+  sp_stack stack = init_stack(0);
+
+  int log[128] = {0};
+  int len = 0;
+
+  struct rec recs[4];
+  sp_ctx ctxs[4];
+  for (int i = 0; i < 4; i++) {
+    recs[i] = (struct rec){.id = i + 1, .steps = 1 + 2 * i, .log = log,
+                           .len = &len};
+    ctxs[i] = create_ctx(stack, logger, &recs[i]);
+  }
+
+  int finished = 0;
+  while (!finished) {
+    yield_ctx(stack);
+    log[len++] = 0;
+
+    finished = 1;
+    for (int i = 0; i < 4; i++)
+      finished &= is_ctx_finished(ctxs[i]);
+  }
+
+  int prev[4], prev_len = -1;
+  int round[4], round_len = 0;
+  for (int i = 0; i < len; i++) {
+    if (log[i] != 0) {
+      ASSERT_TRUE(round_len < 4, "A coroutine was scheduled twice in a round");
+      round[round_len++] = log[i];
+      continue;
+    }
+
+    if (prev_len >= 0) {
+      // The new round is the previous one minus the finished coroutines
+      int j = 0;
+      for (int k = 0; k < prev_len && j < round_len; k++)
+        if (prev[k] == round[j])
+          j++;
+      ASSERT_TRUE(j == round_len, "Round order changed after a completion");
+    }
+
+    for (int k = 0; k < round_len; k++)
+      prev[k] = round[k];
+    prev_len = round_len;
+    round_len = 0;
+  }
+
+  for (int i = 0; i < 4; i++)
+    destroy_ctx(ctxs[i]);
+  deinit_stack(stack);
+  return 0;
+}
+
+struct chain {
+  int links;         // Links run so far
+  int before_queued; // Links that ran before the queued context
+  bool queued_ran;
+};
+
+static void queued_ctx(sp_stack stack, void *arg) {
+  (void)stack;
+  struct chain *c = arg;
+  c->queued_ran = true;
+  c->before_queued = c->links;
+}
+
+// Each link spawns the next one and returns
+static void link(sp_stack stack, void *arg) {
+  struct chain *c = arg;
+  if (++c->links < 100)
+    detach_ctx(create_ctx(stack, link, c));
+}
+
+// New contexts must not jump ahead of the contexts already runnable: a
+// chain of coroutines each spawning the next one would otherwise run to its
+// end before anything else
+static int check_spawn_fairness(void) {
+  sp_stack stack = init_stack(0);
+  struct chain c = {0};
+
+  detach_ctx(create_ctx(stack, link, &c));
+  sp_ctx queued = create_ctx(stack, queued_ctx, &c);
+  await_ctx(stack, queued);
+  ASSERT_TRUE(c.before_queued == 1, "queued context should run second");
+
+  while (c.links < 100)
+    yield_ctx(stack);
+  yield_ctx(stack); // The last link is destroyed at the next switch
+
+  destroy_ctx(queued);
+  deinit_stack(stack);
+  return 0;
+}
+
 int main(void) {
+  if (check_stable_rounds() != 0)
+    return 1;
+  if (check_spawn_fairness() != 0)
+    return 1;
+
   sp_stack stack = init_stack(0);
 
   int log[32] = {0};
@@ -64,7 +167,7 @@ int main(void) {
   ASSERT_TRUE(count_b == b.steps, "Coroutine B log count mismatch");
   ASSERT_TRUE(count_main >= 1, "Main should have logged activity");
 
-  // The first non-main entry should be from the last created coroutine (LIFO)
+  // New contexts are queued at the tail: the first created runs first
   int first_non_main = -1;
   for (int i = 0; i < len; i++) {
     if (log[i] != 0) {
@@ -72,7 +175,8 @@ int main(void) {
       break;
     }
   }
-  ASSERT_TRUE(first_non_main == 2, "Yield rotation should start with newest ctx");
+  ASSERT_TRUE(first_non_main == 1,
+              "Yield rotation should start with the oldest ctx");
 
   printf("test_yield_order passed\n");
   return 0;